@@ -0,0 +1,31 @@
+#include "vm.h"
+
+#define HASH_BENCH_BYTES (256L << 20)
+#define HASH_BENCH_MAX (1 << 20)
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main() {
+  initVM();
+  static char buffer[HASH_BENCH_MAX];
+  for (int i = 0; i < HASH_BENCH_MAX; i++) buffer[i] = (char)(i * 131 + 7);
+  int sizes[] = {8, 16, 32, 64, 256, 1024, 4096, 65536, HASH_BENCH_MAX};
+  for (int k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+    int length = sizes[k];
+    long iterations = HASH_BENCH_BYTES / length;
+    uint32_t checksum = 0;
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+      buffer[0] = (char)i;
+      checksum += hashString(buffer, length);
+    }
+    double elapsed = now() - start;
+    printf("%8d B: %8.2f GB/s %10.2f ns/hash (%u)\n", length, HASH_BENCH_BYTES / elapsed / 1e9,
+           elapsed / iterations * 1e9, checksum & 1);
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "vm.h"
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void benchTable(int n) {
+  StringObject **keys = (StringObject **)malloc(sizeof(StringObject *) * n * 2);
+  if (keys == NULL) exit(1);
+  char buffer[32];
+  for (int i = 0; i < n * 2; i++) {
+    int length = snprintf(buffer, sizeof(buffer), "key_%d", i);
+    keys[i] = copyString(buffer, length);
+  }
+  int reps = 10000000 / n;
+  long checksum = 0;
+  Value value;
+  HashTable table;
+  hashTableInit(&table);
+
+  double start = now();
+  for (int r = 0; r < reps; r++) {
+    hashTableDelete(&table);
+    for (int i = 0; i < n; i++) hashTableInsertValue(&table, keys[i], TO_INTEGER(i));
+  }
+  double insert = (now() - start) / reps / n * 1e9;
+
+  start = now();
+  for (int r = 0; r < reps; r++) {
+    for (int i = 0; i < n; i++) {
+      hashTableGetValue(&table, keys[i], &value);
+      checksum += AS_INTEGER(value);
+    }
+  }
+  double hit = (now() - start) / reps / n * 1e9;
+
+  start = now();
+  for (int r = 0; r < reps; r++) {
+    for (int i = n; i < n * 2; i++) checksum += hashTableGetValue(&table, keys[i], &value);
+  }
+  double miss = (now() - start) / reps / n * 1e9;
+
+  start = now();
+  for (int r = 0; r < reps; r++) {
+    for (int i = 0; i < n * 2; i++) {
+      checksum += hashTableFindString(&table, keys[i]->str, keys[i]->length, keys[i]->obj.hash) != NULL;
+    }
+  }
+  double find = (now() - start) / reps / n / 2 * 1e9;
+
+  start = now();
+  for (int r = 0; r < reps; r++) {
+    for (int i = 0; i < n; i++) {
+      hashTableDeleteValue(&table, keys[(i + r * 7) % (n * 2)]);
+      hashTableInsertValue(&table, keys[(i * 31 + r) % (n * 2)], TO_INTEGER(i));
+    }
+  }
+  double churn = (now() - start) / reps / n / 2 * 1e9;
+
+  printf("n=%-7d insert %6.1f  hit %6.1f  miss %6.1f  findString %6.1f  delete/insert %6.1f ns/op (%ld)\n", n, insert,
+         hit, miss, find, churn, checksum % 2);
+  hashTableDelete(&table);
+  free(keys);
+}
+
+int main(int argc, const char *argv[]) {
+  initVM();
+  vm.gc.enabled = false;
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) benchTable(atoi(argv[i]));
+  } else {
+    benchTable(1000);
+    benchTable(100000);
+  }
+  return 0;
+}
@@ -9,5 +9,8 @@ void writeChunk(Chunk*, uint8_t, int);
 void deleteChunk(Chunk*);
 
 int addConst(Chunk*, Value);
+int instructionSize(Chunk*, int);
+
+uint64_t hashChunk(Chunk*);
 
 #endif
\ No newline at end of file
@@ -1,16 +1,22 @@
 #ifndef MLC_COMMON_H
 #define MLC_COMMON_H
 
+#include <errno.h>
 #include <float.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
@@ -18,6 +24,12 @@
 #define FRAMES_MAX 256
 #define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define GC_PAUSE_BUCKETS 16
+#define GC_PAGE_SIZE (32 * 1024)
+#define GC_GRANULE 16
+#define GC_PAGE_WORDS (GC_PAGE_SIZE / GC_GRANULE / 64)
+#define GC_SIZE_CLASSES ((GC_GRANULE * 2 + UINT8_COUNT * sizeof(void*)) / GC_GRANULE)
+#define INTERPOLATION_MAX 8
 
 typedef signed char i8;
 typedef short i16;
@@ -124,8 +136,10 @@ typedef enum {
   TOKEN_UNSAFE,         // 83
   TOKEN_LABEL,          // 84
   TOKEN_PRINT,          // 85
-  TOKEN_EOF,            // 86
-  TOKEN_ERR             // 87
+  TOKEN_TO,             // 86
+  TOKEN_INTERPOLATION,  // 87
+  TOKEN_EOF,            // 88
+  TOKEN_ERR             // 89
 } TokenType;
 
 typedef struct {
@@ -139,51 +153,93 @@ typedef struct {
   const char* start;
   const char* current;
   int line;
+  int interpolations;
+  int braces[INTERPOLATION_MAX];
 } Scanner;
 
 typedef enum {
-  OP_SWITCH_START,   // 0
-  OP_SWITCH_END,     // 1
-  OP_CASE,           // 2
-  OP_BRK,            // 3
-  OP_CONT,           // 4
-  OP_CONST,          // 5
-  OP_ADD,            // 6
-  OP_MODULO,         // 7
-  OP_DEFINE_GLOBAL,  // 8
-  OP_SUBTRACT,       // 9
-  OP_NOT,            // 10
-  OP_POP,            // 11
-  OP_GET_GLOBAL,     // 12
-  OP_SET_GLOBAL,     // 13
-  OP_GET_LOCAL,      // 14
-  OP_SET_LOCAL,      // 15
-  OP_JMP_IF_FALSE,   // 16
-  OP_LOOP,           // 17
-  OP_JMP,            // 18
-  OP_MULTIPLY,       // 19
-  OP_DIVIDE,         // 20
-  OP_NEGATE,         // 21
-  OP_RETURN,         // 22
-  OP_NULL,           // 23
-  OP_TRUE,           // 24
-  OP_FALSE,          // 25
-  OP_EQUAL,          // 26
-  OP_NOT_EQUAL,      // 27
-  OP_GREATER,        // 28
-  OP_GREATER_EQUAL,  // 29
-  OP_LESS,           // 30
-  OP_LESS_EQUAL,     // 31
-  OP_PRINT,          // 32
-  OP_PRINT_LN,       // 33
-  OP_CALL,           // 34
-  OP_CLOSURE,        // 35
-  OP_GET_UPVALUE,    // 36
-  OP_SET_UPVALUE,    // 37
-  OP_CLOSE_UPVALUE,  // 38
-  OP_CLASS,          // 39
+  OP_CONST,              // 0
+  OP_ADD,                // 1
+  OP_MODULO,             // 2
+  OP_DEFINE_GLOBAL,      // 3
+  OP_SUBTRACT,           // 4
+  OP_NOT,                // 5
+  OP_POP,                // 6
+  OP_GET_GLOBAL,         // 7
+  OP_SET_GLOBAL,         // 8
+  OP_GET_LOCAL,          // 9
+  OP_SET_LOCAL,          // 10
+  OP_JMP_IF_FALSE,       // 11
+  OP_LOOP,               // 12
+  OP_JMP,                // 13
+  OP_MULTIPLY,           // 14
+  OP_DIVIDE,             // 15
+  OP_NEGATE,             // 16
+  OP_RETURN,             // 17
+  OP_NULL,               // 18
+  OP_TRUE,               // 19
+  OP_FALSE,              // 20
+  OP_EQUAL,              // 21
+  OP_NOT_EQUAL,          // 22
+  OP_GREATER,            // 23
+  OP_GREATER_EQUAL,      // 24
+  OP_LESS,               // 25
+  OP_LESS_EQUAL,         // 26
+  OP_PRINT,              // 27
+  OP_PRINT_LN,           // 28
+  OP_CALL,               // 29
+  OP_CLOSURE,            // 30
+  OP_GET_UPVALUE,        // 31
+  OP_SET_UPVALUE,        // 32
+  OP_CLOSE_UPVALUE,      // 33
+  OP_CLASS,              // 34
+  OP_BITWISE_AND,        // 35
+  OP_BITWISE_OR,         // 36
+  OP_BITWISE_XOR,        // 37
+  OP_BITWISE_NOT,        // 38
+  OP_LEFT_SHIFT,         // 39
+  OP_RIGHT_SHIFT,        // 40
+  OP_ADD_INT,            // 41
+  OP_ADD_NUM,            // 42
+  OP_SUBTRACT_INT,       // 43
+  OP_SUBTRACT_NUM,       // 44
+  OP_MULTIPLY_INT,       // 45
+  OP_MULTIPLY_NUM,       // 46
+  OP_LESS_INT,           // 47
+  OP_LESS_NUM,           // 48
+  OP_LESS_EQUAL_INT,     // 49
+  OP_LESS_EQUAL_NUM,     // 50
+  OP_GREATER_INT,        // 51
+  OP_GREATER_NUM,        // 52
+  OP_GREATER_EQUAL_INT,  // 53
+  OP_GREATER_EQUAL_NUM,  // 54
+  OP_CALL_CLOSURE,       // 55
+  OP_CALL_NATIVE,        // 56
+  OP_FOR_PREP,           // 57
+  OP_FOR_RANGE,          // 58
+  OP_SQRT,               // 59
+  OP_FLOOR,              // 60
+  OP_CEIL,               // 61
+  OP_ROUND,              // 62
+  OP_TRUNC,              // 63
+  OP_ABS,                // 64
+  OP_MIN,                // 65
+  OP_MAX,                // 66
+  OP_POW,                // 67
+  OP_FORMAT,             // 68
+  OP_CALL_TARGET,        // 69
 } OpCode;
 
+typedef enum {
+  FEEDBACK_INTEGER = 1 << 0,
+  FEEDBACK_NUMBER = 1 << 1,
+  FEEDBACK_MIXED = 1 << 2,
+  FEEDBACK_CLOSURE = 1 << 3,
+  FEEDBACK_NATIVE = 1 << 4,
+  FEEDBACK_OTHER = 1 << 5,
+  FEEDBACK_POLYMORPHIC = 1 << 6
+} Feedback;
+
 typedef enum {
   PRE_NONE,
   PRE_ASSIGN,
@@ -191,6 +247,10 @@ typedef enum {
   PRE_LOGICAL_AND,
   PRE_EQUALITY,
   PRE_COMP,
+  PRE_BITWISE_OR,
+  PRE_BITWISE_XOR,
+  PRE_BITWISE_AND,
+  PRE_SHIFT,
   PRE_TERM,
   PRE_FACTOR,
   PRE_UNARY,
@@ -202,6 +262,7 @@ typedef enum {
   _BOOLEAN,
   _NULL,
   _NUMBER,
+  _INTEGER,
   _OBJECT
 } ValueType;
 
@@ -210,6 +271,7 @@ typedef enum {
   CLOSURE_OBJECT,
   NATIVE_OBJECT,
   STRING_OBJECT,
+  ROPE_OBJECT,
   FUNCTION_OBJECT,
   CLASS_OBJECT
 } ObjectType;
@@ -217,25 +279,44 @@ typedef enum {
 typedef struct Object Object;
 
 struct Object {
-  ObjectType type;
-  bool isMarked;
-  Object* next;
+  uint8_t type;
+  bool isOld;
+  bool isRemembered;
+  uint8_t age;
+  uint32_t hash;
 };
 
+typedef enum {
+  STRING_INLINE,
+  STRING_OWNED,
+  STRING_STATIC,
+  STRING_VIEW
+} StringStorage;
+
 typedef struct StringObject StringObject;
 
 struct StringObject {
   Object obj;
   int length;
+  uint8_t storage;
+  bool interned;
   char* str;
-  uint32_t hash;
+  char chars[];
 };
 
+typedef struct {
+  Object obj;
+  int length;
+  Object* left;
+  Object* right;
+} RopeObject;
+
 typedef struct {
   ValueType type;
   union {
     bool boolean;
     double number;
+    int64_t integer;
     Object* object;
   } as;
 } Value;
@@ -274,7 +355,9 @@ typedef struct {
 
 typedef struct {
   int count;
+  int tombstones;
   int capacity;
+  uint8_t* control;
   Entry* entries;
 } HashTable;
 
@@ -289,13 +372,22 @@ typedef enum {
   TYPE_SCRIPT
 } FunctionType;
 
-typedef struct {
+typedef struct ClosureObject ClosureObject;
+
+typedef struct FunctionObject FunctionObject;
+
+struct FunctionObject {
   Object obj;
   int arity;
   int upvalueCount;
+  int maxStack;
   Chunk chunk;
   StringObject* name;
-} FunctionObject;
+  ClosureObject* closure;
+  uint64_t codeHash;
+  uint8_t* feedback;
+  FunctionObject** callTargets;
+};
 
 typedef struct {
   uint8_t index;
@@ -308,40 +400,191 @@ struct UpvalueObject {
   Object obj;
   Value* loc;
   Value closed;
-  UpvalueObject* next;
 };
 
-typedef struct {
+struct ClosureObject {
   Object obj;
   FunctionObject* function;
-  UpvalueObject** upvalues;
   int upvalueCount;
-} ClosureObject;
+  UpvalueObject* upvalues[];
+};
 
 typedef struct {
   ClosureObject* closure;
   uint8_t* instrPtr;
   Value* slots;
+  int openCount;
 } StackFrame;
 
 typedef struct {
-  UpvalueObject* openUpvalues;
+  uint64_t hash;
+  int codeLength;
+  uint8_t* feedback;
+  uint64_t* targets;
+} Profile;
+
+typedef enum {
+  GC_IDLE,
+  GC_MARK,
+  GC_SWEEP
+} GCPhase;
+
+typedef struct HeapPage HeapPage;
+
+struct HeapPage {
+  HeapPage* next;
+  uint8_t* base;
+  int sizeClass;
+  int slotCount;
+  int liveCount;
+  int allocWord;
+  unsigned sweptEpoch;
+  _Atomic uint64_t marks[GC_PAGE_WORDS];
+  uint64_t live[GC_PAGE_WORDS];
+};
+
+typedef struct Region Region;
+
+struct Region {
+  Region* next;
+  uint8_t* top;
+  uint8_t* end;
+};
+
+typedef struct LargeObject LargeObject;
+
+struct LargeObject {
+  LargeObject* prev;
+  LargeObject* next;
+  size_t size;
+  size_t payload;
+};
+
+typedef struct {
+  HeapPage* pages[GC_SIZE_CLASSES];
+  HeapPage* cursor[GC_SIZE_CLASSES];
+  uint64_t slotStarts[GC_SIZE_CLASSES][GC_PAGE_WORDS];
+  LargeObject* large;
+  size_t largeBytes;
+  LargeObject* largeCache;
+  size_t largeCacheBytes;
+  Region* objectRegions;
+  unsigned epoch;
+  int pageCount;
+  int largeCount;
+  int largeCacheCount;
+  int regionCount;
+} Heap;
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int round;
+  int top;
+  int count;
+  int capacity;
+  Object** items;
+  atomic_int available;
+  int localCount;
+  int localCapacity;
+  Object** local;
+} MarkWorker;
+
+typedef struct {
+  size_t minHeap;
+  size_t targetHeap;
+  double growthFactor;
+  double survivalRate;
+  size_t nurserySize;
+  size_t youngBytes;
+  int promoteAge;
+  bool enabled;
+  bool minor;
+  GCPhase phase;
+  size_t cycleStart;
+  int sweepClass;
+  HeapPage* sweepPrev;
+  HeapPage* sweepPage;
+  double pauseTarget;
+  bool concurrent;
+  bool concurrentCycle;
+  bool compiling;
+  bool markerStarted;
+  bool markerWork;
+  bool markerShutdown;
+  pthread_t marker;
+  pthread_mutex_t heapLock;
+  pthread_mutex_t markerLock;
+  pthread_cond_t markerWake;
+  int markerGrayCount;
+  int markerGrayCapacity;
+  Object** markerGray;
+  int workers;
+  MarkWorker* markWorkers;
+  atomic_int activeWorkers;
+  int poolThreads;
+  int poolRound;
+  int poolRunning;
+  bool poolShutdown;
+  pthread_mutex_t poolLock;
+  pthread_cond_t poolWake;
+  pthread_cond_t poolIdle;
+  bool stress;
+  bool trace;
+  bool stats;
+  bool cacheLarge;
+  int collections;
+  int minorCollections;
+  int pauseCount;
+  double pauseTotal;
+  double pauseMax;
+  int pauseHistogram[GC_PAUSE_BUCKETS];
+} GCPacer;
+
+typedef struct {
+  StringObject* source;
+  StringObject* separator;
+  int index;
+  int start;
+  int end;
+} SplitCursor;
+
+typedef struct {
   StackFrame frames[FRAMES_MAX];
   int frameCount;
   Value stack[STACK_MAX];
-  Value switchVal[STACK_MAX];
-  bool caseVal[STACK_MAX];
-  bool* caseValTop;
-  Value* switchValTop;
+  UpvalueObject* openUpvalues[STACK_MAX];
   Value* stackTop;
-  Object* objects;
+  Heap heap;
+  int youngCount;
+  int youngCapacity;
+  Object** young;
+  int youngStringCount;
+  int youngStringCapacity;
+  StringObject** youngStrings;
   HashTable strings;
   HashTable globals;
+  StringObject* singleBytes[UINT8_COUNT];
+  SplitCursor splitCursor;
   int grayCount;
   int grayCapacity;
   Object** grayStack;
+  int rememberedCount;
+  int rememberedCapacity;
+  Object** remembered;
   size_t bytesAllocated;
   size_t nextGC;
+  GCPacer gc;
+  const char* nativeError;
+  uint32_t shadowedIntrinsics;
+  uint64_t hashSeed;
+  bool profiling;
+  int profileCount;
+  int profileCapacity;
+  Profile* profiles;
+  int sourceCount;
+  int sourceCapacity;
+  char** sources;
 } VM;
 
 typedef void (*ParseFn)(bool);
@@ -354,22 +597,43 @@ typedef struct {
 
 typedef struct Compiler Compiler;
 
+typedef struct Loop Loop;
+
+struct Loop {
+  Loop* enclosing;
+  bool isSwitch;
+  int start;
+  int scopeDepth;
+  int breakCount;
+  int breakJumps[UINT8_COUNT];
+  int continueCount;
+  int continueJumps[UINT8_COUNT];
+};
+
 typedef Value (*NativeFx)(int argCount, Value* args);
 
+typedef int (*SearchFx)(const char* haystack, int length, const char* needle, int needleLength);
+
 typedef struct {
   Object obj;
   NativeFx fx;
 } NativeObject;
 
+typedef struct {
+  const char* name;
+  int arity;
+  OpCode op;
+  NativeFx fx;
+} Intrinsic;
+
 struct Compiler {
   Compiler* enclosing;
   Local locals[UINT8_COUNT];
   Upvalue upvalues[UINT8_COUNT];
-  int labels[UINT8_MAX];
   FunctionObject* function;
+  Loop* loop;
   FunctionType type;
   int localCount;
-  int labelCount;
   int scopeDepth;
 };
 
@@ -22,11 +22,14 @@ static void initCompiler(Compiler *, FunctionType);
 static void synchronize();
 static void varDeclaration();
 static void defineVariable(uint8_t);
+static void shadowIntrinsic(uint8_t);
+static void intrinsicCall(int, uint8_t, int);
 static void variable(bool);
 static void namedVar(bool);
 static void block();
 static void beginScope();
 static void declareLocalVar();
+static void addLocal(Token);
 static void endScope();
 static void markInitialized();
 static void backpatchJump(int);
@@ -36,15 +39,19 @@ static void logicalOr(bool);
 static void emitLoop(int);
 static void whileStatement();
 static void fromStatement();
+static void rangeStatement();
 static void switchStatement();
+static void beginLoop(Loop *, int, bool);
+static void endLoop(Loop *);
+static void discardLoopLocals(Loop *);
 static void function(FunctionType);
 static void functionDeclaration();
 static void classDeclaration();
 static void returnStatement();
 static void call(bool);
 static void incOrDec(bool);
-static void cont(bool);
-static void _brk(bool);
+static void breakStatement();
+static void continueStatement();
 static void expressionStatement();
 static void printStatement();
 static void statement();
@@ -66,6 +73,8 @@ static void emitConst(Value);
 static void grouping(bool);
 static void parsePrecedence(Precedence);
 static void string(bool);
+static void interpolation(bool);
+static int stringPart(int);
 
 static uint8_t argList();
 static uint8_t parseVariable(const char *);
@@ -73,6 +82,7 @@ static uint8_t makeConst(Value);
 static uint8_t identifierConst(Token *);
 
 static int emitJump(uint8_t);
+static int emitRangeJump(uint8_t, uint8_t);
 static int addUpvalue(Compiler *, uint8_t, bool);
 static int resolveUpvalue(Compiler *);
 static int resolveLocal(Compiler *);
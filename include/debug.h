@@ -6,9 +6,8 @@
 
 // #define DEBUG_PRINT_CODE
 // #define DEBUG_TRACE_EXECUTION
-#define DEBUG_GC
 
-void disassembleChunk(Chunk *, const char *);
+void disassembleChunk(Chunk *, const char *, int);
 
 int disassembleInstruction(Chunk *, int);
 
@@ -16,5 +15,6 @@ static int simpleInstruction(const char *, int);
 static int constantInstruction(const char *, Chunk *, int);
 static int byteInstruction(const char *, Chunk *, int);
 static int jumpInstruction(const char *, int, Chunk *, int);
+static int rangeInstruction(const char *, int, Chunk *, int);
 
 #endif
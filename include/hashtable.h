@@ -4,7 +4,15 @@
 #include "common.h"
 #include "memory.h"
 
-#define HASH_MAX_LOAD 0.5
+#define HASH_MAX_LOAD 0.875
+#define HASH_GROUP_WIDTH 16
+#define HASH_EMPTY 0x80
+#define HASH_DELETED 0xFE
+#define HASH_H1(hash) ((hash) >> 7)
+#define HASH_H2(hash) ((uint8_t)((hash)&0x7F))
+#define HASH_IS_FULL(control) ((control) < 0x80)
+#define HASH_TABLE_SIZE(cap) ((size_t)(cap) * (sizeof(Entry) + 1))
+#define HASH_GROW_CAPACITY(cap) ((cap) < HASH_GROUP_WIDTH ? HASH_GROUP_WIDTH : (cap)*2)
 
 void hashTableInit(HashTable *);
 void hashTableDelete(HashTable *);
@@ -19,6 +27,12 @@ bool hashTableDeleteValue(HashTable *, StringObject *);
 
 StringObject *hashTableFindString(HashTable *, const char *, int, uint32_t);
 
-static Entry *findEntry(Entry *, int, StringObject *);
+static int findEntry(HashTable *, StringObject *);
+static int findFreeSlot(uint8_t *, int, uint32_t);
+static void removeEntry(HashTable *, int);
+
+static uint32_t groupMatch(const uint8_t *, uint8_t);
+static uint32_t groupMatchEmpty(const uint8_t *);
+static uint32_t groupMatchFree(const uint8_t *);
 
 #endif
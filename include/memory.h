@@ -3,8 +3,54 @@
 
 #include "chunk.h"
 
-#define GC_ON
 #define GC_HEAP_GROW_FACTOR 2
+#define GC_MIN_HEAP (1024 * 1024)
+#define GC_SURVIVAL_WEIGHT 0.5
+#define GC_NURSERY_SIZE (256 * 1024)
+#define GC_PROMOTE_AGE 2
+#define GC_PAUSE_TARGET 0.001
+#define GC_STEP_SIZE (64 * 1024)
+#define GC_STEP_WORK 64
+#define GC_MAX_WORKERS 64
+#define GC_PARALLEL_MIN_HEAP (4 * 1024 * 1024)
+#define GC_WORK_BATCH 32
+#define GC_LARGE_OBJECT (64 * 1024)
+#define GC_LARGE_CACHE 8
+#define GC_LARGE_CACHE_BYTES (4 * 1024 * 1024)
+#define GC_OS_PAGE 4096
+#define GC_REGION_SIZE (1024 * 1024)
+
+#define PAGE_OF(obj) (*(HeapPage **)((uintptr_t)(obj) & ~(uintptr_t)(GC_PAGE_SIZE - 1)))
+#define GRANULE_OF(obj) (((uintptr_t)(obj) & (GC_PAGE_SIZE - 1)) / GC_GRANULE)
+#define MARK_WORD(obj) (&PAGE_OF(obj)->marks[GRANULE_OF(obj) / 64])
+#define MARK_BIT(obj) (UINT64_C(1) << (GRANULE_OF(obj) % 64))
+#define IS_MARKED(obj) ((atomic_load_explicit(MARK_WORD(obj), memory_order_relaxed) & MARK_BIT(obj)) != 0)
+#define REGION_START(region) ((uint8_t *)(region) + ((sizeof(Region) + GC_GRANULE - 1) & ~(size_t)(GC_GRANULE - 1)))
+#define IS_YOUNG_VALUE(value) (IS_OBJECT(value) && !AS_OBJECT(value)->isOld)
+// Marking is incremental update: stores into marked objects shade the new value,
+// roots are rescanned in finishMark, and heapLock orders stores the marker reads.
+#define BEGIN_HEAP_WRITE()                                                                              \
+  do {                                                                                                  \
+    if (vm.gc.concurrentCycle) pthread_mutex_lock(&vm.gc.heapLock);                                     \
+  } while (false)
+#define END_HEAP_WRITE()                                                                                \
+  do {                                                                                                  \
+    if (vm.gc.concurrentCycle) pthread_mutex_unlock(&vm.gc.heapLock);                                   \
+  } while (false)
+#define WRITE_BARRIER(owner, value)                                                                     \
+  do {                                                                                                  \
+    if (((Object *)(owner))->isOld && IS_YOUNG_VALUE(value)) rememberObject((Object *)(owner));         \
+    if (vm.gc.phase == GC_MARK && IS_MARKED(owner)) markValue(value);                                   \
+  } while (false)
+#define GLOBAL_BARRIER(name, value)                                                                     \
+  do {                                                                                                  \
+    if (!(name)->obj.isOld) rememberObject((Object *)(name));                                          \
+    if (IS_YOUNG_VALUE(value)) rememberObject(AS_OBJECT(value));                                        \
+    if (vm.gc.phase == GC_MARK) {                                                                       \
+      markObject((Object *)(name));                                                                     \
+      markValue(value);                                                                                 \
+    }                                                                                                   \
+  } while (false)
 
 #define GROW_CAPACITY(cap) ((cap) < 8 ? 8 : (cap)*2)
 #define GROW_ARRAY(prev, type, curCount, count) (type *)reallocate(prev, sizeof(type) * (curCount), sizeof(type) * (count))
@@ -14,16 +60,72 @@
 
 void *reallocate(void *, size_t, size_t);
 
+void initGC();
+Object *allocateSlot(size_t);
+bool parseGCSize(const char *, size_t *);
+void printGCStats();
+void stopMarker();
+void freeMarkWorkers();
 void freeObjects();
 void markValue(Value);
 void markObject(Object *);
+void rememberObject(Object *);
+void trackYoung(Object *);
+void trackYoungString(StringObject *);
+void promoteAll();
 
 static void freeObject(Object *);
+static void initHeap();
+static HeapPage *newPage(int);
+static Object *takeSlot(HeapPage *);
+static void releaseSlot(Object *);
+static void releasePage(HeapPage *, HeapPage *);
+static void resetCursors();
+static void *regionAllocate(Region **, size_t);
+static void freeRegions(Region **);
+static size_t objectSize(Object *);
+static void *reallocateLarge(void *, size_t, size_t);
+static void linkLarge(LargeObject *);
+static void unlinkLarge(LargeObject *);
+static LargeObject *mapLarge(size_t);
+static void unmapLarge(LargeObject *);
+static void setMark(Object *);
+static void clearMark(Object *);
+static void collectGarbage();
 static void garbageCollect();
-static void markRoots();
-static void traceRefs();
+static void beginCycle();
+static void collectStep(double);
+static void scheduleStep();
+static void startConcurrentMark();
+static bool pollMarker();
+static void *markerThread(void *);
+static void drainMarker();
+static void parallelTrace();
+static void *markWorkerThread(void *);
+static void markWork(MarkWorker *);
+static void pushWork(MarkWorker *, Object *);
+static void shareWork(MarkWorker *, Object **, int);
+static int takeWork(MarkWorker *, MarkWorker *, int);
+static Object *popWork(MarkWorker *);
+static Object *stealWork(MarkWorker *);
+static bool anyWork();
+static void finishMark();
+static void finishCycle();
+static void minorCollect();
+static void recordPause(double);
+static double gcNow();
+static void markRoots(bool);
+static bool traceRefs(double);
 static void blackenObject(Object *);
 static void markArray(ValArr *);
-static void sweep();
+static bool sweepPages(double);
+static void sweepPage(HeapPage *);
+static void sweepYoung();
+static void promoteObject(Object *);
+static void pruneRemembered();
+static void pruneYoungStrings();
+static bool hasYoungRefs(Object *);
+static void paceGC(size_t);
+static bool envFlag(const char *);
 
 #endif
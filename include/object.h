@@ -11,40 +11,75 @@
 
 #define AS_BOOL(value) ((value).as.boolean)
 #define AS_NUMBER(value) ((value).as.number)
+#define AS_INTEGER(value) ((value).as.integer)
+#define AS_DOUBLE(value) (IS_INTEGER(value) ? (double)AS_INTEGER(value) : AS_NUMBER(value))
 #define AS_CLOSURE(value) ((ClosureObject *)AS_OBJECT(value))
 #define AS_NATIVE(value) (((NativeObject *)AS_OBJECT(value))->fx)
 #define AS_FUNCTION(value) ((FunctionObject *)AS_OBJECT(value))
 #define AS_OBJECT(value) ((value).as.object)
 #define AS_STRING(value) ((StringObject *)AS_OBJECT(value))
 #define AS_CSTRING(value) (((StringObject *)AS_OBJECT(value))->str)
+#define AS_ROPE(value) ((RopeObject *)AS_OBJECT(value))
 #define AS_CLASS(value) (((ClassObject *)AS_OBJECT(value)))
 
 #define TO_BOOL(value) ((Value){_BOOLEAN, {.boolean = value}})
 #define TO_NUMBER(value) ((Value){_NUMBER, {.number = value}})
+#define TO_INTEGER(value) ((Value){_INTEGER, {.integer = value}})
 #define TO_NULL ((Value){_NULL, {.number = 0}})
 #define TO_OBJECT(obj) ((Value){_OBJECT, {.object = (Object *)obj}})
 
 #define IS_BOOL(value) ((value).type == _BOOLEAN)
 #define IS_NUMBER(value) ((value).type == _NUMBER)
-#define IS_CLOSURE(value) isObjectType(value, CLOSURE_OBJECT);
+#define IS_INTEGER(value) ((value).type == _INTEGER)
+#define IS_NUMERIC(value) (IS_NUMBER(value) || IS_INTEGER(value))
+#define IS_CLOSURE(value) isObjectType(value, CLOSURE_OBJECT)
 #define IS_NATIVE(value) isObjectType(value, NATIVE_OBJECT)
 #define IS_FUNCTION(value) isObjectType(value, FUNCTION_OBJECT)
 #define IS_OBJECT(value) ((value).type == _OBJECT)
 #define IS_STRING(value) isObjectType(value, STRING_OBJECT)
 #define IS_STRING(value) isObjectType(value, STRING_OBJECT)
+#define IS_ROPE(value) isObjectType(value, ROPE_OBJECT)
+#define IS_TEXT(value) (IS_STRING(value) || IS_ROPE(value))
 #define IS_CLASS(value) isObjectType(value, CLASS_OBJECT)
 #define IS_NULL(value) ((value).type == _NULL)
 
 #define ALLOCATE_OBJECT(type, objectType) (type *)allocateObject(sizeof(type), objectType)
 
+#define ROPE_MIN_LENGTH 64
+#define STRING_INLINE_MAX ((int)(GC_SIZE_CLASSES * GC_GRANULE - sizeof(StringObject) - 1))
+#define STRING_PARENT(string) (*(StringObject **)(string)->chars)
+#define SLICE_MIN_LENGTH 16
+#define SLICE_RETAIN_MAX (64 * 1024)
+#define SLICE_RETAIN_RATIO 8
+#define FORMAT_NUMBER_MAX 32
+#define HASH_SECRET0 0xa0761d6478bd642full
+#define HASH_SECRET1 0xe7037ed1a0b428dbull
+#define HASH_SECRET2 0x8ebc6af09c88c6e3ull
+#define HASH_SECRET3 0x589965cc75374cc3ull
+
 void printObject(Value);
 
 static void printFunction(FunctionObject *);
+static void printRope(RopeObject *);
 
 StringObject *copyString(const char *, int);
-StringObject *getString(char *, int);
+StringObject *newString(const char *, int);
+StringObject *staticString(const char *, int);
+StringObject *sliceString(StringObject *, int, int);
+bool stringsEqual(StringObject *, StringObject *);
+StringObject *formatString(Value *, int);
+StringObject *reserveString(int);
+uint32_t hashString(const char *, int);
+
+static int integerLength(int64_t);
+static void writeInteger(int64_t, char *);
+static StringObject *allocateString(char *, int, StringStorage);
+static StringObject *insertString(StringObject *);
+
+RopeObject *newRope(Object *, Object *);
+StringObject *flattenRope(RopeObject *);
 
-static StringObject *allocateString(char *, int, uint32_t);
+static void copyRope(RopeObject *, char *);
 
 FunctionObject *newFunction();
 ClassObject *newClass(StringObject *);
@@ -57,10 +92,16 @@ ClosureObject *newClosure(FunctionObject *);
 
 static Object *allocateObject(size_t, ObjectType);
 
-static uint32_t hashString(const char *, int);
+static uint64_t hashMix(uint64_t, uint64_t);
+static uint64_t readWord(const uint8_t *);
+static uint64_t readHalf(const uint8_t *);
 
 static inline bool isObjectType(Value value, ObjectType type) {
   return IS_OBJECT(value) && AS_OBJECT(value)->type == type;
 }
 
+static inline int textLength(Object *text) {
+  return text->type == STRING_OBJECT ? ((StringObject *)text)->length : ((RopeObject *)text)->length;
+}
+
 #endif
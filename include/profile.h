@@ -0,0 +1,34 @@
+#ifndef MLC_PROFILE_H
+#define MLC_PROFILE_H
+
+#include "chunk.h"
+#include "common.h"
+#include "object.h"
+
+#define PROFILE_MAGIC "MLC-PROFILE"
+#define PROFILE_VERSION 2
+
+void recordBinaryFeedback(FunctionObject *, int, Value, Value);
+void recordCallFeedback(FunctionObject *, int, Value);
+void setCallTarget(FunctionObject *, int, FunctionObject *);
+void applyProfile(FunctionObject *);
+void collectProfile(FunctionObject *);
+void deleteProfiles();
+
+bool loadProfile(const char *);
+bool saveProfile(const char *);
+
+static void recordFeedback(FunctionObject *, int, uint8_t);
+
+static uint8_t quickenedOp(uint8_t, uint8_t);
+static uint8_t feedbackOf(uint8_t);
+
+static Profile *findProfile(uint64_t, int);
+static Profile *addProfile(uint64_t, int);
+static uint8_t mergeTarget(Profile *, int, uint64_t);
+
+static void gatherFunctions(FunctionObject *, FunctionObject ***, int *, int *);
+static void quickenFunction(FunctionObject *, FunctionObject **, int);
+static FunctionObject *findTarget(FunctionObject **, int, uint64_t);
+
+#endif
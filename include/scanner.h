@@ -9,6 +9,7 @@ static void ignoreWhiteSpaceAndComments();
 
 static bool isAtEnd();
 static bool isDigit(char);
+static bool isHexDigit(char);
 static bool isAlpha(char);
 static bool match(char);
 
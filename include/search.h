@@ -0,0 +1,10 @@
+#ifndef MLC_SEARCH_H
+#define MLC_SEARCH_H
+
+#include "common.h"
+
+void initSearch();
+
+int searchString(const char *, int, const char *, int);
+
+#endif
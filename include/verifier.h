@@ -0,0 +1,17 @@
+#ifndef MLC_VERIFIER_H
+#define MLC_VERIFIER_H
+
+#include "chunk.h"
+#include "common.h"
+#include "object.h"
+
+bool verifyFunction(FunctionObject *);
+
+static bool verifyError(FunctionObject *, int, const char *);
+static bool verifyLayout(FunctionObject *, bool *);
+static bool verifyOperands(FunctionObject *, int, int);
+static bool verifyConstant(FunctionObject *, int, int, ObjectType);
+static bool mergeDepth(FunctionObject *, int *, int *, int *, int, int, bool *);
+static int stackEffect(uint8_t, uint8_t, int *);
+
+#endif
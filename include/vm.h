@@ -8,30 +8,77 @@
 #include "hashtable.h"
 #include "memory.h"
 #include "object.h"
+#include "profile.h"
+#include "search.h"
 #include "value.h"
+#include "verifier.h"
+
+#define INTRINSIC_BIT(op) (1u << ((op)-OP_SQRT))
+
+extern const Intrinsic intrinsics[];
 
 void initVM();
 void deleteVM();
 void push(Value);
 
+int findIntrinsic(const char *, int);
+
+static const char *retainSource(const char *);
 static void initStack();
 static void runtimeError(const char *, ...);
 static void concatString();
+static void flattenOperands();
 static void defineNative(const char *, NativeFx);
-static void closeUpvalues(Value *);
+static void closeUpvalues(StackFrame *, Value *);
 
 static bool isFalse(Value);
 static bool callValue(Value, int);
+static bool callNative(NativeFx, int);
+static bool callShadowedIntrinsic(StringObject *, int);
+static bool checkMathArgs(int, Value *, int);
+static bool checkStringArgs(int, Value *, int, int);
+static bool checkPattern(StringObject *);
+static bool checkIndex(Value, int64_t, int64_t, int64_t *);
 static bool vmCall(ClosureObject *, int);
+static bool enterFrame(ClosureObject *, int);
 
 Value pop();
 
 static Value nativeClock(int, Value *);
+static Value nativeSqrt(int, Value *);
+static Value nativeFloor(int, Value *);
+static Value nativeCeil(int, Value *);
+static Value nativeRound(int, Value *);
+static Value nativeTrunc(int, Value *);
+static Value nativeAbs(int, Value *);
+static Value nativeMin(int, Value *);
+static Value nativeMax(int, Value *);
+static Value nativePow(int, Value *);
+static Value nativeLen(int, Value *);
+static Value nativeSlice(int, Value *);
+static Value nativeCharAt(int, Value *);
+static Value nativeIndexOf(int, Value *);
+static Value nativeContains(int, Value *);
+static Value nativeCount(int, Value *);
+static Value nativeSplit(int, Value *);
+static Value nativeReplace(int, Value *);
+static Value mathSqrt(Value);
+static Value integralValue(double);
+static Value mathFloor(Value);
+static Value mathCeil(Value);
+static Value mathRound(Value);
+static Value mathTrunc(Value);
+static Value mathAbs(Value);
+static Value mathMin(Value, Value);
+static Value mathMax(Value, Value);
+static Value mathPow(Value, Value);
 static Value vmStackPeek(int);
 
 IR interpret(const char *);
 static IR run();
 
-static UpvalueObject *captureUpvalue(Value *);
+static UpvalueObject *captureUpvalue(StackFrame *, Value *);
+
+static int pieceEnd(StringObject *, StringObject *, int);
 
 #endif
\ No newline at end of file
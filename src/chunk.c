@@ -32,4 +32,55 @@ int addConst(Chunk *chunk, Value val) {
   writeVal(&chunk->constants, val);
   pop(vm);
   return chunk->constants.count - 1;
+}
+
+int instructionSize(Chunk *chunk, int offset) {
+  switch (chunk->code[offset]) {
+    case OP_CONST:
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_CALL:
+    case OP_CALL_CLOSURE:
+    case OP_CALL_NATIVE:
+    case OP_CALL_TARGET:
+    case OP_CLASS:
+    case OP_SQRT:
+    case OP_FLOOR:
+    case OP_CEIL:
+    case OP_ROUND:
+    case OP_TRUNC:
+    case OP_ABS:
+    case OP_MIN:
+    case OP_MAX:
+    case OP_POW:
+    case OP_FORMAT:
+      return 2;
+    case OP_JMP:
+    case OP_JMP_IF_FALSE:
+    case OP_LOOP:
+      return 3;
+    case OP_FOR_PREP:
+    case OP_FOR_RANGE:
+      return 4;
+    case OP_CLOSURE: {
+      FunctionObject *fx = AS_FUNCTION(chunk->constants.values[chunk->code[offset + 1]]);
+      return 2 + fx->upvalueCount * 2;
+    }
+    default:
+      return 1;
+  }
+}
+
+uint64_t hashChunk(Chunk *chunk) {
+  uint64_t hash = 14695981039346656037u;
+  for (int i = 0; i < chunk->count; i++) {
+    hash ^= chunk->code[i];
+    hash *= 1099511628211u;
+  }
+  return hash;
 }
\ No newline at end of file
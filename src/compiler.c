@@ -17,9 +17,14 @@ FunctionObject *compile(const char *source) {
 FunctionObject *endCompilation() {
   emitReturn(parser);
   FunctionObject *function = current->function;
+  function->codeHash = hashChunk(&function->chunk);
 #ifdef DEBUG_PRINT_CODE
   if (!parser.hadErr) {
-    disassembleChunk(currentChunk(), function->name != NULL ? function->name->str : "<script>");
+    if (function->name != NULL) {
+      disassembleChunk(currentChunk(), function->name->str, function->name->length);
+    } else {
+      disassembleChunk(currentChunk(), "<script>", 8);
+    }
   }
 #endif
   current = current->enclosing;
@@ -40,11 +45,12 @@ void initCompiler(Compiler *compiler, FunctionType type) {
   compiler->type = type;
   compiler->localCount = 0;
   compiler->scopeDepth = 0;
-  compiler->labelCount = 0;
+  compiler->loop = NULL;
   compiler->function = newFunction();
   current = compiler;
   if (type != TYPE_SCRIPT) {
-    current->function->name = copyString(parser.prev.start, parser.prev.length);
+    current->function->name = staticString(parser.prev.start, parser.prev.length);
+    WRITE_BARRIER(current->function, TO_OBJECT(current->function->name));
   }
   Local *local = &current->locals[current->localCount++];
   local->depth = 0;
@@ -90,15 +96,38 @@ void defineVariable(uint8_t global) {
     markInitialized();
     return;
   }
+  shadowIntrinsic(global);
   emitBytes(OP_DEFINE_GLOBAL, global);
 }
 
+void shadowIntrinsic(uint8_t global) {
+  StringObject *name = AS_STRING(currentChunk()->constants.values[global]);
+  int index = findIntrinsic(name->str, name->length);
+  if (index != -1) vm.shadowedIntrinsics |= INTRINSIC_BIT(intrinsics[index].op);
+}
+
+void intrinsicCall(int index, uint8_t global, int start) {
+  advance();
+  uint8_t argCount = argList();
+  if (argCount != intrinsics[index].arity || (vm.shadowedIntrinsics & INTRINSIC_BIT(intrinsics[index].op))) {
+    emitBytes(OP_CALL, argCount);
+    return;
+  }
+  Chunk *chunk = currentChunk();
+  int size = instructionSize(chunk, start);
+  memmove(&chunk->code[start], &chunk->code[start + size], chunk->count - start - size);
+  memmove(&chunk->lines[start], &chunk->lines[start + size], sizeof(int) * (chunk->count - start - size));
+  chunk->count -= size;
+  emitBytes(intrinsics[index].op, global);
+}
+
 void variable(bool canAssign) {
   namedVar(canAssign);
 }
 
 void namedVar(bool canAssign) {
   uint8_t getOp, setOp;
+  Token name = parser.prev;
   int arg = resolveLocal(current);
   if (arg != -1) {
     getOp = OP_GET_LOCAL;
@@ -111,13 +140,20 @@ void namedVar(bool canAssign) {
     getOp = OP_GET_GLOBAL;
     setOp = OP_SET_GLOBAL;
   }
+  if (setOp == OP_SET_GLOBAL && ((canAssign && check(TOKEN_EQUAL)) || check(TOKEN_INCREMENT) || check(TOKEN_DECREMENT))) {
+    shadowIntrinsic((uint8_t)arg);
+  }
   if (canAssign && matchToken(TOKEN_EQUAL)) {
     expression();
     emitBytes(setOp, (uint8_t)arg);
   } else {
+    int start = currentChunk()->count;
     emitBytes(getOp, (uint8_t)arg);
-    if (parser.cur.type == TOKEN_INCREMENT || parser.cur.type == TOKEN_DECREMENT) {
-      emitConst(TO_NUMBER(1));
+    int index;
+    if (getOp == OP_GET_GLOBAL && check(TOKEN_LEFT_PAREN) && (index = findIntrinsic(name.start, name.length)) != -1) {
+      intrinsicCall(index, (uint8_t)arg, start);
+    } else if (parser.cur.type == TOKEN_INCREMENT || parser.cur.type == TOKEN_DECREMENT) {
+      emitConst(TO_INTEGER(1));
       emitByte(parser.cur.type == TOKEN_INCREMENT ? OP_ADD : OP_SUBTRACT);
       emitBytes(setOp, (uint8_t)arg);
       advance();
@@ -148,12 +184,16 @@ void declareLocalVar() {
       error("Identifier has already been declared.");
     }
   }
+  addLocal(parser.prev);
+}
+
+void addLocal(Token name) {
   if (current->localCount == UINT8_COUNT) {
     error("Stack Overflow.");
     return;
   }
-  local = &current->locals[current->localCount++];
-  local->name = parser.prev;
+  Local *local = &current->locals[current->localCount++];
+  local->name = name;
   local->depth = -1;
   local->isCaptured = false;
 }
@@ -218,89 +258,180 @@ void emitLoop(int loopStart) {
 }
 
 void whileStatement() {
+  Loop loop;
   int loopStart = currentChunk()->count;
-  int curLabelCount = current->labelCount;
+  beginLoop(&loop, loopStart, false);
   expression();
   int exitJmpOffset = emitJump(OP_JMP_IF_FALSE);
-  current->labels[current->labelCount++] = exitJmpOffset;
-  current->labels[current->labelCount++] = loopStart;
   emitByte(OP_POP);
   statement();
   emitLoop(loopStart);
   backpatchJump(exitJmpOffset);
   emitByte(OP_POP);
-  if (curLabelCount != current->labelCount) current->labelCount = curLabelCount;
+  endLoop(&loop);
 }
 
 void fromStatement() {
   beginScope();
   if (matchToken(TOKEN_SEMI)) {
   } else if (matchToken(TOKEN_VAR)) {
-    varDeclaration();
+    parseVariable("Expected a variable name");
+    if (matchToken(TOKEN_EQUAL)) {
+      expression();
+    } else {
+      emitByte(OP_NULL);
+    }
+    markInitialized();
+    if (matchToken(TOKEN_TO)) {
+      rangeStatement();
+      endScope();
+      return;
+    }
+    consume(TOKEN_SEMI, "Expected ';' after value");
   } else {
-    expressionStatement();
+    expression();
+    if (matchToken(TOKEN_TO)) {
+      Token counter = {TOKEN_IDENTIFIER, "i", 1, parser.prev.line};
+      addLocal(counter);
+      markInitialized();
+      rangeStatement();
+      endScope();
+      return;
+    }
+    consume(TOKEN_SEMI, "Expected ';' after value");
+    emitByte(OP_POP);
   }
-  int curLabelCount = current->labelCount;
   int loopStart = currentChunk()->count;
   int exitJmp = -1;
   if (!matchToken(TOKEN_SEMI)) {
     expression();
     consume(TOKEN_SEMI, "Expected ';' after loop condition");
     exitJmp = emitJump(OP_JMP_IF_FALSE);
-    current->labels[current->labelCount++] = exitJmp;
     emitByte(OP_POP);
-  } else {
-    exitJmp = emitJump(OP_JMP_IF_FALSE);
-    current->labels[current->labelCount++] = exitJmp;
-    current->labels[current->labelCount++] = exitJmp;
   }
   if (!check(TOKEN_LEFT_BRACE)) {
     int bodyJmp = emitJump(OP_JMP);
     int incrementStart = currentChunk()->count;
-    if (!matchToken(TOKEN_LEFT_BRACE)) {
-      expression();
-    }
+    expression();
     emitByte(OP_POP);
     emitLoop(loopStart);
     loopStart = incrementStart;
-    current->labels[current->labelCount++] = loopStart;
     backpatchJump(bodyJmp);
   }
+  Loop loop;
+  beginLoop(&loop, loopStart, false);
   statement();
   emitLoop(loopStart);
   if (exitJmp != -1) {
     backpatchJump(exitJmp);
     emitByte(OP_POP);
   }
-  endScope(parser);
-  if (curLabelCount != current->labelCount) current->labelCount = curLabelCount;
+  endLoop(&loop);
+  endScope();
+}
+
+void rangeStatement() {
+  uint8_t counter = current->localCount - 1;
+  expression();
+  Token limit = {TOKEN_TO, "to", 2, parser.prev.line};
+  addLocal(limit);
+  markInitialized();
+  int exitJmp = emitRangeJump(OP_FOR_PREP, counter);
+  int bodyStart = currentChunk()->count;
+  Loop loop;
+  beginLoop(&loop, -1, false);
+  statement();
+  for (int i = 0; i < loop.continueCount; i++) {
+    backpatchJump(loop.continueJumps[i]);
+  }
+  emitByte(OP_FOR_RANGE);
+  emitByte(counter);
+  int offset = currentChunk()->count - bodyStart + 2;
+  if (offset > UINT16_MAX) error("Stack Overflow.");
+  emitBytes((offset >> 8) & 0xff, offset & 0xff);
+  backpatchJump(exitJmp);
+  endLoop(&loop);
 }
 
 void switchStatement() {
   beginScope();
   expression();
-  emitByte(OP_SWITCH_START);
+  Token value = {TOKEN_SWITCH, "switch", 6, parser.prev.line};
+  addLocal(value);
+  markInitialized();
+  uint8_t slot = current->localCount - 1;
   consume(TOKEN_LEFT_BRACE, "Expected '{' after switch expression");
-  int exitJmp = -1;
-  while (matchToken(TOKEN_CASE) || check(TOKEN_DEFAULT)) {
-    if (!check(TOKEN_DEFAULT)) {
+  Loop loop;
+  beginLoop(&loop, -1, true);
+  int nextCase = -1;
+  int skipDefault = -1;
+  int fallJump = -1;
+  int defaultStart = -1;
+  while (matchToken(TOKEN_CASE) || matchToken(TOKEN_DEFAULT)) {
+    if (parser.prev.type == TOKEN_CASE) {
+      if (nextCase != -1) {
+        backpatchJump(nextCase);
+        emitByte(OP_POP);
+      }
+      if (skipDefault != -1) {
+        backpatchJump(skipDefault);
+        skipDefault = -1;
+      }
+      emitBytes(OP_GET_LOCAL, slot);
       expression();
       consume(TOKEN_LABEL, "Expected ':' after case expression");
+      emitByte(OP_EQUAL);
+      nextCase = emitJump(OP_JMP_IF_FALSE);
+      emitByte(OP_POP);
     } else {
-      matchToken(TOKEN_DEFAULT);
       consume(TOKEN_LABEL, "Expected ':' after def");
+      if (defaultStart != -1) error("Multiple 'def' labels in switch");
+      if (fallJump == -1 && nextCase == -1) skipDefault = emitJump(OP_JMP);
+      defaultStart = currentChunk()->count;
     }
-    emitByte(OP_CASE);
-    exitJmp = emitJump(OP_JMP_IF_FALSE);
-    emitByte(OP_POP);
-    while (!check(TOKEN_CASE) && !check(TOKEN_DEFAULT) && !check(TOKEN_RIGHT_BRACE))
+    if (fallJump != -1) backpatchJump(fallJump);
+    beginScope();
+    while (!check(TOKEN_CASE) && !check(TOKEN_DEFAULT) && !check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
       declaration();
-    if (!check(TOKEN_DEFAULT)) backpatchJump(exitJmp);
-    if (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_DEFAULT)) emitByte(OP_POP);
+    }
+    endScope();
+    fallJump = emitJump(OP_JMP);
   }
   consume(TOKEN_RIGHT_BRACE, "Expected '}' at the end of switch statement");
-  emitByte(OP_SWITCH_END);
-  endScope(parser);
+  if (nextCase != -1 || skipDefault != -1) {
+    if (nextCase != -1) {
+      backpatchJump(nextCase);
+      emitByte(OP_POP);
+    }
+    if (skipDefault != -1) backpatchJump(skipDefault);
+    if (defaultStart != -1) emitLoop(defaultStart);
+  }
+  if (fallJump != -1) backpatchJump(fallJump);
+  endLoop(&loop);
+  endScope();
+}
+
+void beginLoop(Loop *loop, int start, bool isSwitch) {
+  loop->enclosing = current->loop;
+  loop->isSwitch = isSwitch;
+  loop->start = start;
+  loop->scopeDepth = current->scopeDepth;
+  loop->breakCount = 0;
+  loop->continueCount = 0;
+  current->loop = loop;
+}
+
+void endLoop(Loop *loop) {
+  for (int i = 0; i < loop->breakCount; i++) {
+    backpatchJump(loop->breakJumps[i]);
+  }
+  current->loop = loop->enclosing;
+}
+
+void discardLoopLocals(Loop *loop) {
+  for (int i = current->localCount - 1; i >= 0 && current->locals[i].depth > loop->scopeDepth; i--) {
+    emitByte(current->locals[i].isCaptured ? OP_CLOSE_UPVALUE : OP_POP);
+  }
 }
 
 void function(FunctionType t) {
@@ -371,19 +502,36 @@ void incOrDec(bool canAssign) {
   variable(canAssign);
 }
 
-void cont(bool canAssign) {
-  emitLoop(current->labels[current->labelCount - 1]);
-  current->labelCount -= 2;
+void breakStatement() {
+  consume(TOKEN_SEMI, "Expected ';' after 'brk'");
+  Loop *loop = current->loop;
+  if (loop == NULL) {
+    error("Syntax Error: 'brk' outside loop or switch");
+    return;
+  }
+  if (loop->breakCount == UINT8_COUNT) {
+    error("Too many 'brk' statements in one loop");
+    return;
+  }
+  discardLoopLocals(loop);
+  loop->breakJumps[loop->breakCount++] = emitJump(OP_JMP);
 }
 
-void _brk(bool canAssign) {
-  if (current->labelCount > 0) {
-    emitConst(TO_BOOL(false));
-    current->labelCount--;
-    emitLoop(current->labels[current->labelCount - 1] - 1);
-    current->labelCount--;
+void continueStatement() {
+  consume(TOKEN_SEMI, "Expected ';' after 'cont'");
+  Loop *loop = current->loop;
+  while (loop != NULL && loop->isSwitch) loop = loop->enclosing;
+  if (loop == NULL) {
+    error("Syntax Error: 'cont' outside loop");
+    return;
+  }
+  discardLoopLocals(loop);
+  if (loop->start != -1) {
+    emitLoop(loop->start);
+  } else if (loop->continueCount == UINT8_COUNT) {
+    error("Too many 'cont' statements in one loop");
   } else {
-    emitByte(OP_BRK);
+    loop->continueJumps[loop->continueCount++] = emitJump(OP_JMP);
   }
 }
 
@@ -419,6 +567,10 @@ void statement() {
     endScope(parser);
   } else if (matchToken(TOKEN_RETURN)) {
     returnStatement();
+  } else if (matchToken(TOKEN_BRK)) {
+    breakStatement();
+  } else if (matchToken(TOKEN_CONT)) {
+    continueStatement();
   } else {
     expressionStatement();
   }
@@ -496,8 +648,22 @@ void emitBytes(uint8_t b1, uint8_t b2) {
 }
 
 void number(bool canAssign) {
-  double value = strtod(parser.prev.start, NULL);
-  emitConst(TO_NUMBER(value));
+  const char *start = parser.prev.start;
+  int base = 10;
+  if (parser.prev.length > 2 && start[0] == '0' && (start[1] == 'x' || start[1] == 'b')) {
+    base = start[1] == 'x' ? 16 : 2;
+    start += 2;
+  } else if (memchr(start, '.', parser.prev.length) != NULL) {
+    emitConst(TO_NUMBER(strtod(start, NULL)));
+    return;
+  }
+  errno = 0;
+  uint64_t value = strtoull(start, NULL, base);
+  if (errno == ERANGE || (base == 10 && value > INT64_MAX)) {
+    error("Integer literal is too large");
+    return;
+  }
+  emitConst(TO_INTEGER((int64_t)value));
 }
 
 void unary(bool canAssign) {
@@ -510,6 +676,9 @@ void unary(bool canAssign) {
     case TOKEN_BANG:
       emitByte(OP_NOT);
       break;
+    case TOKEN_BITWISE_NOT:
+      emitByte(OP_BITWISE_NOT);
+      break;
   }
 }
 
@@ -551,6 +720,21 @@ void binary(bool canAssign) {
     case TOKEN_LESS_EQUAL:
       emitByte(OP_LESS_EQUAL);
       break;
+    case TOKEN_BITWISE_AND:
+      emitByte(OP_BITWISE_AND);
+      break;
+    case TOKEN_BITWISE_OR:
+      emitByte(OP_BITWISE_OR);
+      break;
+    case TOKEN_BITWISE_XOR:
+      emitByte(OP_BITWISE_XOR);
+      break;
+    case TOKEN_LEFT_SHIFT:
+      emitByte(OP_LEFT_SHIFT);
+      break;
+    case TOKEN_RIGHT_SHIFT:
+      emitByte(OP_RIGHT_SHIFT);
+      break;
   }
 }
 
@@ -597,7 +781,30 @@ void parsePrecedence(Precedence precedence) {
 }
 
 void string(bool canAssign) {
-  emitConst(TO_OBJECT(copyString(parser.prev.start + 1, parser.prev.length - 2)));
+  emitConst(TO_OBJECT(staticString(parser.prev.start + 1, parser.prev.length - 2)));
+}
+
+void interpolation(bool canAssign) {
+  int count = 0;
+  do {
+    count += stringPart(3);
+    expression();
+    count++;
+  } while (matchToken(TOKEN_INTERPOLATION));
+  consume(TOKEN_STRING, "Expected '}' after interpolated expression.");
+  if (parser.prev.type == TOKEN_STRING) count += stringPart(2);
+  if (count > UINT8_MAX) {
+    error("Too many parts in one interpolated string");
+    return;
+  }
+  emitBytes(OP_FORMAT, (uint8_t)count);
+}
+
+int stringPart(int delimiters) {
+  int length = parser.prev.length - delimiters;
+  if (length == 0) return 0;
+  emitConst(TO_OBJECT(staticString(parser.prev.start + 1, length)));
+  return 1;
 }
 
 uint8_t argList() {
@@ -624,6 +831,7 @@ uint8_t parseVariable(const char *err) {
 
 uint8_t makeConst(Value value) {
   int constant = addConst(currentChunk(), value);
+  WRITE_BARRIER(current->function, value);
   if (constant > UINT8_MAX) {
     error("Too many constants in one chunk");
     return 0;
@@ -632,7 +840,7 @@ uint8_t makeConst(Value value) {
 }
 
 uint8_t identifierConst(Token *name) {
-  return makeConst(TO_OBJECT(copyString(name->start, name->length)));
+  return makeConst(TO_OBJECT(staticString(name->start, name->length)));
 }
 
 int emitJump(uint8_t instr) {
@@ -642,6 +850,13 @@ int emitJump(uint8_t instr) {
   return currentChunk()->count - 2;
 }
 
+int emitRangeJump(uint8_t instr, uint8_t slot) {
+  emitBytes(instr, slot);
+  emitByte(0xff);
+  emitByte(0xff);
+  return currentChunk()->count - 2;
+}
+
 int addUpvalue(Compiler *compiler, uint8_t index, bool isLocal) {
   int upvalueCount = compiler->function->upvalueCount;
   for (int i = 0; i < upvalueCount; i++) {
@@ -731,6 +946,7 @@ ParseRule rules[] = {
     [TOKEN_LOGICAL_OR] = {NULL, logicalOr, PRE_LOGICAL_OR},
     [TOKEN_IDENTIFIER] = {variable, NULL, PRE_NONE},
     [TOKEN_STRING] = {string, NULL, PRE_NONE},
+    [TOKEN_INTERPOLATION] = {interpolation, NULL, PRE_NONE},
     [TOKEN_NUMBER] = {number, NULL, PRE_NONE},
     [TOKEN_CONST] = {NULL, NULL, PRE_NONE},
     [TOKEN_ENUM] = {NULL, NULL, PRE_NONE},
@@ -744,6 +960,7 @@ ParseRule rules[] = {
     [TOKEN_TRUE] = {literal, NULL, PRE_NONE},
     [TOKEN_FALSE] = {literal, NULL, PRE_NONE},
     [TOKEN_FROM] = {NULL, NULL, PRE_NONE},
+    [TOKEN_TO] = {NULL, NULL, PRE_NONE},
     [TOKEN_WHILE] = {NULL, NULL, PRE_NONE},
     [TOKEN_DO] = {NULL, NULL, PRE_NONE},
     [TOKEN_IF] = {NULL, NULL, PRE_NONE},
@@ -759,8 +976,8 @@ ParseRule rules[] = {
     [TOKEN_THROW] = {NULL, NULL, PRE_NONE},
     [TOKEN_THROWS] = {NULL, NULL, PRE_NONE},
     [TOKEN_YIELD] = {NULL, NULL, PRE_NONE},
-    [TOKEN_BRK] = {_brk, NULL, PRE_NONE},
-    [TOKEN_CONT] = {cont, NULL, PRE_NONE},
+    [TOKEN_BRK] = {NULL, NULL, PRE_NONE},
+    [TOKEN_CONT] = {NULL, NULL, PRE_NONE},
     [TOKEN_MIXIN] = {NULL, NULL, PRE_NONE},
     [TOKEN_STRUCT] = {NULL, NULL, PRE_NONE},
     [TOKEN_OBJECT] = {NULL, NULL, PRE_NONE},
@@ -770,7 +987,7 @@ ParseRule rules[] = {
     [TOKEN_EXT] = {NULL, NULL, PRE_NONE},
     [TOKEN_FINAL] = {NULL, NULL, PRE_NONE},
     [TOKEN_VR] = {NULL, NULL, PRE_NONE},
-    [TOKEN_ABS] = {NULL, NULL, PRE_NONE},
+    [TOKEN_ABS] = {variable, NULL, PRE_NONE},
     [TOKEN_PUB] = {NULL, NULL, PRE_NONE},
     [TOKEN_PRIV] = {NULL, NULL, PRE_NONE},
     [TOKEN_PROT] = {NULL, NULL, PRE_NONE},
@@ -784,12 +1001,12 @@ ParseRule rules[] = {
     [TOKEN_NEW] = {NULL, NULL, PRE_NONE},
     [TOKEN_DELETE] = {NULL, NULL, PRE_NONE},
     [TOKEN_LOGICAL_NOT] = {NULL, NULL, PRE_NONE},
-    [TOKEN_BITWISE_AND] = {NULL, NULL, PRE_NONE},
-    [TOKEN_BITWISE_OR] = {NULL, NULL, PRE_NONE},
-    [TOKEN_BITWISE_NOT] = {NULL, NULL, PRE_NONE},
-    [TOKEN_BITWISE_XOR] = {NULL, NULL, PRE_NONE},
-    [TOKEN_LEFT_SHIFT] = {NULL, NULL, PRE_NONE},
-    [TOKEN_RIGHT_SHIFT] = {NULL, NULL, PRE_NONE},
+    [TOKEN_BITWISE_AND] = {NULL, binary, PRE_BITWISE_AND},
+    [TOKEN_BITWISE_OR] = {NULL, binary, PRE_BITWISE_OR},
+    [TOKEN_BITWISE_NOT] = {unary, NULL, PRE_NONE},
+    [TOKEN_BITWISE_XOR] = {NULL, binary, PRE_BITWISE_XOR},
+    [TOKEN_LEFT_SHIFT] = {NULL, binary, PRE_SHIFT},
+    [TOKEN_RIGHT_SHIFT] = {NULL, binary, PRE_SHIFT},
     [TOKEN_ERR] = {NULL, NULL, PRE_NONE},
     [TOKEN_EOF] = {NULL, NULL, PRE_NONE},
 };
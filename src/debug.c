@@ -1,8 +1,8 @@
 #include "debug.h"
 
-void disassembleChunk(Chunk *chunk, const char *name) {
+void disassembleChunk(Chunk *chunk, const char *name, int length) {
   printf("\nDisassembling chunk\n\n");
-  printf("=========================== %s ===============================\n", name);
+  printf("=========================== %.*s ===============================\n", length, name);
   printf("offset    line    opcode            constIndex    constValue\n");
   for (int offset = 0; offset < chunk->count;) {
     offset = disassembleInstruction(chunk, offset);
@@ -39,16 +39,6 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       }
       return offset;
     }
-    case OP_SWITCH_END:
-      return simpleInstruction("    OP_SWITCH_END", offset);
-    case OP_SWITCH_START:
-      return simpleInstruction("    OP_SWITCH_START", offset);
-    case OP_CASE:
-      return simpleInstruction("    OP_CASE", offset);
-    case OP_BRK:
-      return simpleInstruction("    OP_BRK", offset);
-    case OP_CONT:
-      return simpleInstruction("    OP_CONT", offset);
     case OP_TRUE:
       return simpleInstruction("    OP_TRUE", offset);
     case OP_FALSE:
@@ -95,6 +85,10 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       return jumpInstruction("    OP_JMP           ", 1, chunk, offset);
     case OP_JMP_IF_FALSE:
       return jumpInstruction("    OP_JMP_IF_FALSE  ", 1, chunk, offset);
+    case OP_FOR_PREP:
+      return rangeInstruction("    OP_FOR_PREP      ", 1, chunk, offset);
+    case OP_FOR_RANGE:
+      return rangeInstruction("    OP_FOR_RANGE     ", -1, chunk, offset);
     case OP_NOT_EQUAL:
       return simpleInstruction("    OP_NOT_EQUAL", offset);
     case OP_GREATER:
@@ -105,6 +99,72 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       return simpleInstruction("    OP_LESS", offset);
     case OP_LESS_EQUAL:
       return simpleInstruction("    OP_LESS_EQUAL", offset);
+    case OP_BITWISE_AND:
+      return simpleInstruction("    OP_BITWISE_AND", offset);
+    case OP_BITWISE_OR:
+      return simpleInstruction("    OP_BITWISE_OR", offset);
+    case OP_BITWISE_XOR:
+      return simpleInstruction("    OP_BITWISE_XOR", offset);
+    case OP_BITWISE_NOT:
+      return simpleInstruction("    OP_BITWISE_NOT", offset);
+    case OP_LEFT_SHIFT:
+      return simpleInstruction("    OP_LEFT_SHIFT", offset);
+    case OP_RIGHT_SHIFT:
+      return simpleInstruction("    OP_RIGHT_SHIFT", offset);
+    case OP_ADD_INT:
+      return simpleInstruction("    OP_ADD_INT", offset);
+    case OP_ADD_NUM:
+      return simpleInstruction("    OP_ADD_NUM", offset);
+    case OP_SUBTRACT_INT:
+      return simpleInstruction("    OP_SUBTRACT_INT", offset);
+    case OP_SUBTRACT_NUM:
+      return simpleInstruction("    OP_SUBTRACT_NUM", offset);
+    case OP_MULTIPLY_INT:
+      return simpleInstruction("    OP_MULTIPLY_INT", offset);
+    case OP_MULTIPLY_NUM:
+      return simpleInstruction("    OP_MULTIPLY_NUM", offset);
+    case OP_LESS_INT:
+      return simpleInstruction("    OP_LESS_INT", offset);
+    case OP_LESS_NUM:
+      return simpleInstruction("    OP_LESS_NUM", offset);
+    case OP_LESS_EQUAL_INT:
+      return simpleInstruction("    OP_LESS_EQUAL_INT", offset);
+    case OP_LESS_EQUAL_NUM:
+      return simpleInstruction("    OP_LESS_EQUAL_NUM", offset);
+    case OP_GREATER_INT:
+      return simpleInstruction("    OP_GREATER_INT", offset);
+    case OP_GREATER_NUM:
+      return simpleInstruction("    OP_GREATER_NUM", offset);
+    case OP_GREATER_EQUAL_INT:
+      return simpleInstruction("    OP_GREATER_EQUAL_INT", offset);
+    case OP_GREATER_EQUAL_NUM:
+      return simpleInstruction("    OP_GREATER_EQUAL_NUM", offset);
+    case OP_CALL_CLOSURE:
+      return byteInstruction("    OP_CALL_CLOSURE     ", chunk, offset);
+    case OP_CALL_NATIVE:
+      return byteInstruction("    OP_CALL_NATIVE      ", chunk, offset);
+    case OP_CALL_TARGET:
+      return byteInstruction("    OP_CALL_TARGET      ", chunk, offset);
+    case OP_SQRT:
+      return constantInstruction("    OP_SQRT             ", chunk, offset);
+    case OP_FLOOR:
+      return constantInstruction("    OP_FLOOR            ", chunk, offset);
+    case OP_CEIL:
+      return constantInstruction("    OP_CEIL             ", chunk, offset);
+    case OP_ROUND:
+      return constantInstruction("    OP_ROUND            ", chunk, offset);
+    case OP_TRUNC:
+      return constantInstruction("    OP_TRUNC            ", chunk, offset);
+    case OP_ABS:
+      return constantInstruction("    OP_ABS              ", chunk, offset);
+    case OP_MIN:
+      return constantInstruction("    OP_MIN              ", chunk, offset);
+    case OP_MAX:
+      return constantInstruction("    OP_MAX              ", chunk, offset);
+    case OP_POW:
+      return constantInstruction("    OP_POW              ", chunk, offset);
+    case OP_FORMAT:
+      return byteInstruction("    OP_FORMAT           ", chunk, offset);
     case OP_PRINT:
       return simpleInstruction("    OP_PRINT", offset);
     case OP_PRINT_LN:
@@ -139,4 +199,12 @@ int jumpInstruction(const char *name, int sign, Chunk *chunk, int offset) {
   jmp |= chunk->code[offset + 2];
   printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jmp);
   return offset + 3;
+}
+
+int rangeInstruction(const char *name, int sign, Chunk *chunk, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint16_t jmp = (uint16_t)(chunk->code[offset + 2] << 8);
+  jmp |= chunk->code[offset + 3];
+  printf("%-16s %4d -> %d    slot %d\n", name, offset, offset + 4 + sign * jmp, slot);
+  return offset + 4;
 }
\ No newline at end of file
@@ -1,47 +1,51 @@
 #include "hashtable.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void hashTableInit(HashTable *hashTable) {
   hashTable->count = 0;
+  hashTable->tombstones = 0;
   hashTable->capacity = 0;
+  hashTable->control = NULL;
   hashTable->entries = NULL;
 }
 
 void hashTableDelete(HashTable *hashTable) {
-  DELETE_ARRAY(Entry, hashTable->entries, hashTable->capacity);
+  DELETE_ARRAY(char, hashTable->entries, HASH_TABLE_SIZE(hashTable->capacity));
   hashTableInit(hashTable);
 }
 
 void hashTableCopy(HashTable *from, HashTable *to) {
   for (int i = 0; i < from->capacity; i++) {
-    Entry *entry = &from->entries[i];
-    if (entry->key != NULL) {
-      hashTableInsertValue(to, entry->key, entry->value);
+    if (HASH_IS_FULL(from->control[i])) {
+      hashTableInsertValue(to, from->entries[i].key, from->entries[i].value);
     }
   }
 }
 
 void increaseCapacity(HashTable *hashTable, int capacity) {
-  Entry *entries = ALLOCATE(Entry, capacity);
-  for (int i = 0; i < capacity; i++) {
-    entries[i].key = NULL;
-    entries[i].value = TO_NULL;
-  }
-  hashTable->count = 0;
+  Entry *entries = (Entry *)ALLOCATE(char, HASH_TABLE_SIZE(capacity));
+  uint8_t *control = (uint8_t *)(entries + capacity);
+  memset(control, HASH_EMPTY, capacity);
   for (int i = 0; i < hashTable->capacity; i++) {
+    if (!HASH_IS_FULL(hashTable->control[i])) continue;
     Entry *entry = &hashTable->entries[i];
-    if (entry->key == NULL) continue;
-    Entry *dest = findEntry(entries, capacity, entry->key);
-    dest->key = entry->key;
-    dest->value = entry->value;
-    hashTable->count++;
+    int index = findFreeSlot(control, capacity, entry->key->obj.hash);
+    control[index] = hashTable->control[i];
+    entries[index] = *entry;
   }
-  DELETE_ARRAY(Entry, hashTable->entries, hashTable->capacity);
+  DELETE_ARRAY(char, hashTable->entries, HASH_TABLE_SIZE(hashTable->capacity));
+  hashTable->control = control;
   hashTable->entries = entries;
   hashTable->capacity = capacity;
+  hashTable->tombstones = 0;
 }
 
 void markTable(HashTable *hashTable) {
   for (int i = 0; i < hashTable->capacity; i++) {
+    if (!HASH_IS_FULL(hashTable->control[i])) continue;
     Entry *entry = &hashTable->entries[i];
     markObject((Object *)entry->key);
     markValue(entry->value);
@@ -50,71 +54,141 @@ void markTable(HashTable *hashTable) {
 
 void hashTableRemoveWhite(HashTable *hashTable) {
   for (int i = 0; i < hashTable->capacity; i++) {
-    Entry *entry = &hashTable->entries[i];
-    if (entry->key != NULL && !entry->key->obj.isMarked) {
-      hashTableDeleteValue(hashTable, entry->key);
-    }
+    if (!HASH_IS_FULL(hashTable->control[i])) continue;
+    StringObject *key = hashTable->entries[i].key;
+    if (!IS_MARKED(&key->obj)) removeEntry(hashTable, i);
   }
 }
 
 bool hashTableGetValue(HashTable *hashTable, StringObject *key, Value *value) {
   if (hashTable->count == 0) return false;
-  Entry *entry = findEntry(hashTable->entries, hashTable->capacity, key);
-  if (entry->key == NULL) return false;
-  *value = entry->value;
+  int index = findEntry(hashTable, key);
+  if (index < 0) return false;
+  *value = hashTable->entries[index].value;
   return true;
 }
 
 bool hashTableInsertValue(HashTable *hashTable, StringObject *key, Value value) {
-  if (hashTable->count + 1 > hashTable->capacity * HASH_MAX_LOAD) {
-    int cap = GROW_CAPACITY(hashTable->capacity);
-    increaseCapacity(hashTable, cap);
+  if (hashTable->count + hashTable->tombstones + 1 > hashTable->capacity * HASH_MAX_LOAD) {
+    bool rehash = hashTable->count + 1 <= hashTable->capacity * HASH_MAX_LOAD / 2;
+    increaseCapacity(hashTable, rehash ? hashTable->capacity : HASH_GROW_CAPACITY(hashTable->capacity));
+  }
+  uint32_t mask = hashTable->capacity / HASH_GROUP_WIDTH - 1;
+  uint32_t group = HASH_H1(key->obj.hash) & mask;
+  int index = -1;
+  for (uint32_t step = 1;; step++) {
+    const uint8_t *control = hashTable->control + group * HASH_GROUP_WIDTH;
+    for (uint32_t bits = groupMatch(control, HASH_H2(key->obj.hash)); bits != 0; bits &= bits - 1) {
+      Entry *entry = &hashTable->entries[group * HASH_GROUP_WIDTH + __builtin_ctz(bits)];
+      if (entry->key == key) {
+        entry->value = value;
+        return false;
+      }
+    }
+    uint32_t free = index < 0 ? groupMatchFree(control) : 0;
+    if (free != 0) index = group * HASH_GROUP_WIDTH + __builtin_ctz(free);
+    if (groupMatchEmpty(control) != 0) break;
+    group = (group + step) & mask;
   }
-  Entry *entry = findEntry(hashTable->entries, hashTable->capacity, key);
-  bool newKey = entry->key == NULL;
-  if (newKey && IS_NULL(entry->value)) hashTable->count++;
-  entry->key = key;
-  entry->value = value;
-  return newKey;
+  if (hashTable->control[index] == HASH_DELETED) hashTable->tombstones--;
+  hashTable->control[index] = HASH_H2(key->obj.hash);
+  hashTable->entries[index].key = key;
+  hashTable->entries[index].value = value;
+  hashTable->count++;
+  return true;
 }
 
 bool hashTableDeleteValue(HashTable *hashTable, StringObject *key) {
   if (hashTable->count == 0) return false;
-  Entry *entry = findEntry(hashTable->entries, hashTable->capacity, key);
-  if (entry->key == NULL) return false;
-  entry->key = NULL;
-  entry->value = TO_BOOL(true);
+  int index = findEntry(hashTable, key);
+  if (index < 0) return false;
+  removeEntry(hashTable, index);
   return true;
 }
 
 StringObject *hashTableFindString(HashTable *hashTable, const char *str, int length, uint32_t hash) {
   if (hashTable->count == 0) return NULL;
-  uint32_t index = hash % hashTable->capacity;
-  while (true) {
-    Entry *entry = &hashTable->entries[index];
-    if (entry->key == NULL) {
-      if (IS_NULL(entry->value)) return NULL;
-    } else if (entry->key->length == length && entry->key->hash == hash && memcmp(entry->key->str, str, length) == 0) {
-      return entry->key;
+  uint32_t mask = hashTable->capacity / HASH_GROUP_WIDTH - 1;
+  uint32_t group = HASH_H1(hash) & mask;
+  for (uint32_t step = 1;; step++) {
+    const uint8_t *control = hashTable->control + group * HASH_GROUP_WIDTH;
+    for (uint32_t bits = groupMatch(control, HASH_H2(hash)); bits != 0; bits &= bits - 1) {
+      StringObject *key = hashTable->entries[group * HASH_GROUP_WIDTH + __builtin_ctz(bits)].key;
+      if (key->length == length && key->obj.hash == hash && memcmp(key->str, str, length) == 0) return key;
     }
-    index = (index + 1) % hashTable->capacity;
+    if (groupMatchEmpty(control) != 0) return NULL;
+    group = (group + step) & mask;
   }
 }
 
-Entry *findEntry(Entry *entries, int capacity, StringObject *key) {
-  uint32_t index = key->hash % capacity;
-  Entry *tombstone = NULL;
-  while (true) {
-    Entry *entry = &entries[index];
-    if (entry->key == NULL) {
-      if (IS_NULL(entry->value)) {
-        return tombstone != NULL ? tombstone : entry;
-      } else {
-        if (tombstone == NULL) tombstone = entry;
-      }
-    } else if (entry->key == key) {
-      return entry;
+int findEntry(HashTable *hashTable, StringObject *key) {
+  uint32_t mask = hashTable->capacity / HASH_GROUP_WIDTH - 1;
+  uint32_t group = HASH_H1(key->obj.hash) & mask;
+  for (uint32_t step = 1;; step++) {
+    const uint8_t *control = hashTable->control + group * HASH_GROUP_WIDTH;
+    for (uint32_t bits = groupMatch(control, HASH_H2(key->obj.hash)); bits != 0; bits &= bits - 1) {
+      int index = group * HASH_GROUP_WIDTH + __builtin_ctz(bits);
+      if (hashTable->entries[index].key == key) return index;
     }
-    index = (index + 1) % capacity;
+    if (groupMatchEmpty(control) != 0) return -1;
+    group = (group + step) & mask;
+  }
+}
+
+int findFreeSlot(uint8_t *control, int capacity, uint32_t hash) {
+  uint32_t mask = capacity / HASH_GROUP_WIDTH - 1;
+  uint32_t group = HASH_H1(hash) & mask;
+  for (uint32_t step = 1;; step++) {
+    uint32_t bits = groupMatchFree(control + group * HASH_GROUP_WIDTH);
+    if (bits != 0) return group * HASH_GROUP_WIDTH + __builtin_ctz(bits);
+    group = (group + step) & mask;
+  }
+}
+
+void removeEntry(HashTable *hashTable, int index) {
+  const uint8_t *group = hashTable->control + (index & ~(HASH_GROUP_WIDTH - 1));
+  if (groupMatchEmpty(group) != 0) {
+    hashTable->control[index] = HASH_EMPTY;
+  } else {
+    hashTable->control[index] = HASH_DELETED;
+    hashTable->tombstones++;
+  }
+  hashTable->entries[index].key = NULL;
+  hashTable->entries[index].value = TO_NULL;
+  hashTable->count--;
+}
+
+#ifdef __SSE2__
+uint32_t groupMatch(const uint8_t *control, uint8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i *)control);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+uint32_t groupMatchEmpty(const uint8_t *control) {
+  return groupMatch(control, HASH_EMPTY);
+}
+
+uint32_t groupMatchFree(const uint8_t *control) {
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)control));
+}
+#else
+uint32_t groupMatch(const uint8_t *control, uint8_t h2) {
+  uint32_t bits = 0;
+  for (int i = 0; i < HASH_GROUP_WIDTH; i++) {
+    if (control[i] == h2) bits |= 1u << i;
+  }
+  return bits;
+}
+
+uint32_t groupMatchEmpty(const uint8_t *control) {
+  return groupMatch(control, HASH_EMPTY);
+}
+
+uint32_t groupMatchFree(const uint8_t *control) {
+  uint32_t bits = 0;
+  for (int i = 0; i < HASH_GROUP_WIDTH; i++) {
+    if (!HASH_IS_FULL(control[i])) bits |= 1u << i;
   }
+  return bits;
 }
+#endif
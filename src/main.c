@@ -9,22 +9,96 @@
 
 static void MLC_repl();
 static void MLC_compile(const char *filePath);
+static void usage();
 static char *readFile(const char *filePath);
+static bool gcPragma(const char *source);
+
+static const char *profileOut = NULL;
 
 int main(int argc, const char *argv[]) {
+  const char *path = NULL;
+  const char *profileIn = NULL;
+  bool gcStress = false;
+  bool gcTrace = false;
+  bool gcStats = false;
+  bool gcConcurrent = false;
+  bool gcLargeCache = false;
+  int gcWorkers = 0;
+  double gcPauseTarget = 0;
+  size_t gcMinHeap = 0;
+  size_t gcTargetHeap = 0;
+  size_t gcNursery = 0;
+  double gcGrowth = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--profile-in") == 0 && i + 1 < argc) {
+      profileIn = argv[++i];
+    } else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+      profileOut = argv[++i];
+    } else if (strcmp(argv[i], "--gc-stress") == 0) {
+      gcStress = true;
+    } else if (strcmp(argv[i], "--gc-trace") == 0) {
+      gcTrace = true;
+    } else if (strcmp(argv[i], "--gc-concurrent") == 0) {
+      gcConcurrent = true;
+    } else if (strcmp(argv[i], "--gc-large-cache") == 0) {
+      gcLargeCache = true;
+    } else if (strcmp(argv[i], "--gc-workers") == 0 && i + 1 < argc) {
+      gcWorkers = atoi(argv[++i]);
+      if (gcWorkers < 1 || gcWorkers > GC_MAX_WORKERS) usage();
+    } else if (strcmp(argv[i], "--gc-stats") == 0) {
+      gcStats = true;
+    } else if (strcmp(argv[i], "--gc-pause-target") == 0 && i + 1 < argc) {
+      gcPauseTarget = atof(argv[++i]);
+      if (gcPauseTarget <= 0) usage();
+    } else if (strcmp(argv[i], "--gc-min-heap") == 0 && i + 1 < argc) {
+      if (!parseGCSize(argv[++i], &gcMinHeap)) usage();
+    } else if (strcmp(argv[i], "--gc-target-heap") == 0 && i + 1 < argc) {
+      if (!parseGCSize(argv[++i], &gcTargetHeap)) usage();
+    } else if (strcmp(argv[i], "--gc-nursery") == 0 && i + 1 < argc) {
+      if (!parseGCSize(argv[++i], &gcNursery)) usage();
+    } else if (strcmp(argv[i], "--gc-growth") == 0 && i + 1 < argc) {
+      gcGrowth = atof(argv[++i]);
+      if (gcGrowth <= 1) usage();
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      usage();
+    }
+  }
   initVM();
-  if (argc == 1) {
+  if (gcStress) vm.gc.stress = true;
+  if (gcTrace) vm.gc.trace = true;
+  if (gcStats) vm.gc.stats = true;
+  if (gcConcurrent) vm.gc.concurrent = true;
+  if (gcLargeCache) vm.gc.cacheLarge = true;
+  if (gcWorkers > 0) vm.gc.workers = gcWorkers;
+  if (gcPauseTarget > 0) vm.gc.pauseTarget = gcPauseTarget / 1e6;
+  if (gcMinHeap > 0) vm.nextGC = vm.gc.minHeap = gcMinHeap;
+  if (gcTargetHeap > 0) vm.gc.targetHeap = gcTargetHeap;
+  if (gcGrowth > 0) vm.gc.growthFactor = gcGrowth;
+  if (gcNursery > 0) vm.gc.nurserySize = gcNursery;
+  if (profileIn != NULL && !loadProfile(profileIn)) {
+    fprintf(stderr, "Could not read profile \"%s\".\n", profileIn);
+    exit(74);
+  }
+  vm.profiling = profileOut != NULL;
+  if (path == NULL) {
     MLC_repl();
-  } else if (argc == 2) {
-    MLC_compile(argv[1]);
   } else {
-    fprintf(stderr, "Usage: MLC [path]\n");
-    exit(64);
+    MLC_compile(path);
   }
   deleteVM();
   return 0;
 }
 
+void usage() {
+  fprintf(stderr,
+          "Usage: MLC [--profile-in file] [--profile-out file] [--gc-stress] [--gc-trace] [--gc-stats]\n"
+          "           [--gc-concurrent] [--gc-min-heap size] [--gc-target-heap size] [--gc-nursery size]\n"
+          "           [--gc-growth factor] [--gc-pause-target us] [--gc-workers n] [--gc-large-cache] [path]\n");
+  exit(64);
+}
+
 void MLC_repl() {
   char line[1024];
   while (true) {
@@ -39,8 +113,12 @@ void MLC_repl() {
 
 void MLC_compile(const char *filePath) {
   char *source = readFile(filePath);
+  vm.gc.enabled = gcPragma(source);
   IR res = interpret(source);
   free(source);
+  if (profileOut != NULL && !saveProfile(profileOut)) {
+    fprintf(stderr, "Could not write profile \"%s\".\n", profileOut);
+  }
   if (res == I_COMPILE_ERR) exit(65);
   if (res == I_RUNTIME_ERR) exit(70);
 }
@@ -59,4 +137,18 @@ char *readFile(const char *filePath) {
   buffer[bytesRead] = '\0';
   fclose(file);
   return buffer;
+}
+
+bool gcPragma(const char *source) {
+  while (*source == ' ' || *source == '\t') source++;
+  if (*source++ != '#') return false;
+  while (*source == ' ' || *source == '\t') source++;
+  if (strncmp(source, "gc", 2) != 0) return false;
+  source += 2;
+  if (*source != ' ' && *source != '\t') return false;
+  while (*source == ' ' || *source == '\t') source++;
+  if (strncmp(source, "on", 2) != 0) return false;
+  source += 2;
+  while (*source == ' ' || *source == '\t' || *source == '\r') source++;
+  return *source == '\n' || *source == '\0';
 }
\ No newline at end of file
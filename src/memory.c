@@ -1,15 +1,18 @@
+#define _GNU_SOURCE
 #include "memory.h"
 
+static _Thread_local bool onMarkerThread = false;
+static _Thread_local MarkWorker *markWorker = NULL;
+
 void *reallocate(void *prev, size_t curSize, size_t newSize) {
   vm.bytesAllocated += newSize - curSize;
   if (newSize > curSize) {
-#ifdef GC_ON
-    garbageCollect();
-#endif
-    if (vm.bytesAllocated > vm.nextGC) {
-      garbageCollect();
+    vm.gc.youngBytes += newSize - curSize;
+    if (vm.gc.enabled && (vm.gc.stress || vm.bytesAllocated > vm.nextGC || vm.gc.youngBytes > vm.gc.nurserySize)) {
+      collectGarbage();
     }
   }
+  if (curSize >= GC_LARGE_OBJECT || newSize >= GC_LARGE_OBJECT) return reallocateLarge(prev, curSize, newSize);
   if (newSize == 0) {
     free(prev);
     return NULL;
@@ -18,17 +21,432 @@ void *reallocate(void *prev, size_t curSize, size_t newSize) {
   return realloc(prev, newSize);
 }
 
+void *reallocateLarge(void *prev, size_t curSize, size_t newSize) {
+  LargeObject *large = curSize >= GC_LARGE_OBJECT ? (LargeObject *)prev - 1 : NULL;
+  if (newSize < GC_LARGE_OBJECT) {
+    void *small = NULL;
+    if (newSize > 0) {
+      small = malloc(newSize);
+      if (small == NULL) exit(1);
+      memcpy(small, prev, newSize);
+    }
+    unlinkLarge(large);
+    unmapLarge(large);
+    return small;
+  }
+  size_t size = (sizeof(LargeObject) + newSize + GC_OS_PAGE - 1) & ~(size_t)(GC_OS_PAGE - 1);
+  if (large == NULL) {
+    large = mapLarge(size);
+    if (prev != NULL) {
+      memcpy(large + 1, prev, curSize);
+      free(prev);
+    }
+  } else {
+    unlinkLarge(large);
+    if (size > large->size || size * 2 < large->size) {
+#ifdef MREMAP_MAYMOVE
+      large = (LargeObject *)mremap(large, large->size, size, MREMAP_MAYMOVE);
+      if (large == MAP_FAILED) exit(1);
+      large->size = size;
+#else
+      LargeObject *moved = mapLarge(size);
+      memcpy(moved + 1, large + 1, curSize < newSize ? curSize : newSize);
+      unmapLarge(large);
+      large = moved;
+#endif
+    }
+  }
+  large->payload = newSize;
+  linkLarge(large);
+  return large + 1;
+}
+
+LargeObject *mapLarge(size_t size) {
+  for (LargeObject **link = &vm.heap.largeCache; *link != NULL; link = &(*link)->next) {
+    LargeObject *cached = *link;
+    if (cached->size >= size && cached->size / 2 < size) {
+      *link = cached->next;
+      vm.heap.largeCacheBytes -= cached->size;
+      vm.heap.largeCacheCount--;
+      return cached;
+    }
+  }
+  LargeObject *large = (LargeObject *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (large == MAP_FAILED) exit(1);
+  large->size = size;
+  return large;
+}
+
+void unmapLarge(LargeObject *large) {
+  if (vm.gc.cacheLarge && vm.heap.largeCacheCount < GC_LARGE_CACHE && vm.heap.largeCacheBytes + large->size <= GC_LARGE_CACHE_BYTES) {
+    large->next = vm.heap.largeCache;
+    vm.heap.largeCache = large;
+    vm.heap.largeCacheBytes += large->size;
+    vm.heap.largeCacheCount++;
+    return;
+  }
+  munmap(large, large->size);
+}
+
+void linkLarge(LargeObject *large) {
+  large->prev = NULL;
+  large->next = vm.heap.large;
+  if (vm.heap.large != NULL) vm.heap.large->prev = large;
+  vm.heap.large = large;
+  vm.heap.largeBytes += large->size;
+  vm.heap.largeCount++;
+}
+
+void unlinkLarge(LargeObject *large) {
+  if (large->prev != NULL) {
+    large->prev->next = large->next;
+  } else {
+    vm.heap.large = large->next;
+  }
+  if (large->next != NULL) large->next->prev = large->prev;
+  vm.heap.largeBytes -= large->size;
+  vm.heap.largeCount--;
+}
+
+Object *allocateSlot(size_t size) {
+  int sizeClass = (int)((size + GC_GRANULE - 1) / GC_GRANULE) - 1;
+  size_t slotSize = (size_t)(sizeClass + 1) * GC_GRANULE;
+  vm.bytesAllocated += slotSize;
+  if (!vm.gc.enabled) return (Object *)regionAllocate(&vm.heap.objectRegions, slotSize);
+  vm.gc.youngBytes += slotSize;
+  if (vm.gc.stress || vm.bytesAllocated > vm.nextGC || vm.gc.youngBytes > vm.gc.nurserySize) {
+    collectGarbage();
+  }
+  HeapPage *page = vm.heap.cursor[sizeClass];
+  HeapPage *last = NULL;
+  Object *obj = NULL;
+  while (page != NULL && (obj = takeSlot(page)) == NULL) {
+    last = page;
+    page = page->next;
+  }
+  if (page == NULL) {
+    page = newPage(sizeClass);
+    if (last != NULL) {
+      last->next = page;
+    } else {
+      vm.heap.pages[sizeClass] = page;
+    }
+    obj = takeSlot(page);
+  }
+  vm.heap.cursor[sizeClass] = page;
+  if (vm.gc.phase == GC_MARK) setMark(obj);
+  return obj;
+}
+
+void *regionAllocate(Region **regions, size_t size) {
+  Region *region = *regions;
+  if (region == NULL || region->top + size > region->end) {
+    region = (Region *)malloc(GC_REGION_SIZE);
+    if (region == NULL) exit(1);
+    region->next = *regions;
+    region->top = REGION_START(region);
+    region->end = (uint8_t *)region + GC_REGION_SIZE;
+    *regions = region;
+    vm.heap.regionCount++;
+  }
+  void *ptr = region->top;
+  region->top += size;
+  return ptr;
+}
+
+void freeRegions(Region **regions) {
+  while (*regions != NULL) {
+    Region *next = (*regions)->next;
+    free(*regions);
+    *regions = next;
+  }
+}
+
+size_t objectSize(Object *obj) {
+  size_t size = 0;
+  switch (obj->type) {
+    case CLASS_OBJECT:
+      size = sizeof(ClassObject);
+      break;
+    case UPVALUE_OBJECT:
+      size = sizeof(UpvalueObject);
+      break;
+    case CLOSURE_OBJECT:
+      size = sizeof(ClosureObject) + sizeof(UpvalueObject *) * ((ClosureObject *)obj)->upvalueCount;
+      break;
+    case FUNCTION_OBJECT:
+      size = sizeof(FunctionObject);
+      break;
+    case NATIVE_OBJECT:
+      size = sizeof(NativeObject);
+      break;
+    case STRING_OBJECT: {
+      StringObject *string = (StringObject *)obj;
+      size = sizeof(StringObject);
+      if (string->storage == STRING_INLINE) size += string->length + 1;
+      if (string->storage == STRING_VIEW) size += sizeof(StringObject *);
+      break;
+    }
+    case ROPE_OBJECT:
+      size = sizeof(RopeObject);
+      break;
+  }
+  return (size + GC_GRANULE - 1) & ~(size_t)(GC_GRANULE - 1);
+}
+
+void initHeap() {
+  for (int sizeClass = 0; sizeClass < GC_SIZE_CLASSES; sizeClass++) {
+    vm.heap.pages[sizeClass] = NULL;
+    vm.heap.cursor[sizeClass] = NULL;
+    uint64_t *starts = vm.heap.slotStarts[sizeClass];
+    memset(starts, 0, sizeof(vm.heap.slotStarts[sizeClass]));
+    int slotCount = (GC_PAGE_SIZE / GC_GRANULE - 1) / (sizeClass + 1);
+    for (int slot = 0; slot < slotCount; slot++) {
+      int granule = 1 + slot * (sizeClass + 1);
+      starts[granule / 64] |= UINT64_C(1) << (granule % 64);
+    }
+  }
+  vm.heap.large = NULL;
+  vm.heap.largeBytes = 0;
+  vm.heap.largeCache = NULL;
+  vm.heap.largeCacheBytes = 0;
+  vm.heap.objectRegions = NULL;
+  vm.heap.epoch = 0;
+  vm.heap.pageCount = 0;
+  vm.heap.largeCount = 0;
+  vm.heap.largeCacheCount = 0;
+  vm.heap.regionCount = 0;
+}
+
+HeapPage *newPage(int sizeClass) {
+  HeapPage *page = (HeapPage *)calloc(1, sizeof(HeapPage));
+  if (page == NULL) exit(1);
+  page->base = (uint8_t *)aligned_alloc(GC_PAGE_SIZE, GC_PAGE_SIZE);
+  if (page->base == NULL) exit(1);
+  *(HeapPage **)page->base = page;
+  page->sizeClass = sizeClass;
+  page->slotCount = (GC_PAGE_SIZE / GC_GRANULE - 1) / (sizeClass + 1);
+  page->sweptEpoch = vm.heap.epoch;
+  vm.heap.pageCount++;
+  return page;
+}
+
+Object *takeSlot(HeapPage *page) {
+  if (page->sweptEpoch != vm.heap.epoch) sweepPage(page);
+  if (page->liveCount == page->slotCount) return NULL;
+  uint64_t *starts = vm.heap.slotStarts[page->sizeClass];
+  for (int word = page->allocWord; word < GC_PAGE_WORDS; word++) {
+    uint64_t free = starts[word] & ~page->live[word];
+    if (free == 0) continue;
+    int bit = __builtin_ctzll(free);
+    page->live[word] |= UINT64_C(1) << bit;
+    page->liveCount++;
+    page->allocWord = word;
+    return (Object *)(page->base + ((size_t)word * 64 + bit) * GC_GRANULE);
+  }
+  page->allocWord = GC_PAGE_WORDS;
+  return NULL;
+}
+
+void releaseSlot(Object *obj) {
+  HeapPage *page = PAGE_OF(obj);
+  int word = (int)(GRANULE_OF(obj) / 64);
+  page->live[word] &= ~MARK_BIT(obj);
+  page->liveCount--;
+  if (word < page->allocWord) page->allocWord = word;
+  vm.bytesAllocated -= (size_t)(page->sizeClass + 1) * GC_GRANULE;
+}
+
+void releasePage(HeapPage *prev, HeapPage *page) {
+  if (prev != NULL) {
+    prev->next = page->next;
+  } else {
+    vm.heap.pages[page->sizeClass] = page->next;
+  }
+  free(page->base);
+  free(page);
+  vm.heap.pageCount--;
+}
+
+void resetCursors() {
+  for (int sizeClass = 0; sizeClass < GC_SIZE_CLASSES; sizeClass++) {
+    vm.heap.cursor[sizeClass] = vm.heap.pages[sizeClass];
+  }
+}
+
+void setMark(Object *obj) {
+  atomic_fetch_or_explicit(MARK_WORD(obj), MARK_BIT(obj), memory_order_relaxed);
+}
+
+void clearMark(Object *obj) {
+  atomic_fetch_and_explicit(MARK_WORD(obj), ~MARK_BIT(obj), memory_order_relaxed);
+}
+
+void initGC() {
+  initHeap();
+  vm.gc.minHeap = GC_MIN_HEAP;
+  vm.gc.targetHeap = 0;
+  vm.gc.growthFactor = GC_HEAP_GROW_FACTOR;
+  vm.gc.survivalRate = 0;
+  vm.gc.nurserySize = GC_NURSERY_SIZE;
+  vm.gc.youngBytes = 0;
+  vm.gc.promoteAge = GC_PROMOTE_AGE;
+  vm.gc.enabled = true;
+  vm.gc.minor = false;
+  vm.gc.phase = GC_IDLE;
+  vm.gc.cycleStart = 0;
+  vm.gc.sweepClass = GC_SIZE_CLASSES;
+  vm.gc.sweepPrev = NULL;
+  vm.gc.sweepPage = NULL;
+  vm.gc.pauseTarget = GC_PAUSE_TARGET;
+  vm.gc.concurrentCycle = false;
+  vm.gc.compiling = false;
+  vm.gc.markerStarted = false;
+  vm.gc.markerWork = false;
+  vm.gc.markerShutdown = false;
+  vm.gc.markerGrayCount = 0;
+  vm.gc.markerGrayCapacity = 0;
+  vm.gc.markerGray = NULL;
+  vm.gc.workers = 1;
+  vm.gc.markWorkers = NULL;
+  vm.gc.poolThreads = 0;
+  vm.gc.poolRound = 0;
+  vm.gc.poolRunning = 0;
+  vm.gc.poolShutdown = false;
+  pthread_mutex_init(&vm.gc.poolLock, NULL);
+  pthread_cond_init(&vm.gc.poolWake, NULL);
+  pthread_cond_init(&vm.gc.poolIdle, NULL);
+  pthread_mutex_init(&vm.gc.heapLock, NULL);
+  pthread_mutex_init(&vm.gc.markerLock, NULL);
+  pthread_cond_init(&vm.gc.markerWake, NULL);
+  vm.gc.collections = 0;
+  vm.gc.minorCollections = 0;
+  vm.gc.pauseCount = 0;
+  vm.gc.pauseTotal = 0;
+  vm.gc.pauseMax = 0;
+  memset(vm.gc.pauseHistogram, 0, sizeof(vm.gc.pauseHistogram));
+  const char *env;
+  if ((env = getenv("MLC_GC_MIN_HEAP")) != NULL) parseGCSize(env, &vm.gc.minHeap);
+  if ((env = getenv("MLC_GC_TARGET_HEAP")) != NULL) parseGCSize(env, &vm.gc.targetHeap);
+  if ((env = getenv("MLC_GC_GROWTH")) != NULL && atof(env) > 1) vm.gc.growthFactor = atof(env);
+  if ((env = getenv("MLC_GC_NURSERY")) != NULL) parseGCSize(env, &vm.gc.nurserySize);
+  if ((env = getenv("MLC_GC_PROMOTE_AGE")) != NULL && atoi(env) > 0 && atoi(env) < UINT8_MAX) {
+    vm.gc.promoteAge = atoi(env);
+  }
+  if ((env = getenv("MLC_GC_PAUSE_TARGET")) != NULL && atof(env) > 0) vm.gc.pauseTarget = atof(env) / 1e6;
+  if ((env = getenv("MLC_GC_WORKERS")) != NULL && atoi(env) > 0 && atoi(env) <= GC_MAX_WORKERS) {
+    vm.gc.workers = atoi(env);
+  }
+  vm.gc.concurrent = envFlag("MLC_GC_CONCURRENT");
+  vm.gc.stress = envFlag("MLC_GC_STRESS");
+  vm.gc.trace = envFlag("MLC_GC_TRACE");
+  vm.gc.stats = envFlag("MLC_GC_STATS");
+  vm.gc.cacheLarge = envFlag("MLC_GC_LARGE_CACHE");
+  vm.nextGC = vm.gc.minHeap;
+}
+
+bool parseGCSize(const char *str, size_t *size) {
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(str, &end, 10);
+  if (end == str || errno == ERANGE) return false;
+  switch (*end) {
+    case 'k':
+    case 'K':
+      value <<= 10;
+      end++;
+      break;
+    case 'm':
+    case 'M':
+      value <<= 20;
+      end++;
+      break;
+    case 'g':
+    case 'G':
+      value <<= 30;
+      end++;
+      break;
+  }
+  if (*end != '\0') return false;
+  *size = (size_t)value;
+  return true;
+}
+
+bool envFlag(const char *name) {
+  const char *env = getenv(name);
+  return env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+}
+
+void printGCStats() {
+  fprintf(stderr, "gc: %d major, %d minor, %d pauses, total %.3f ms, max %.3f ms\n", vm.gc.collections,
+          vm.gc.minorCollections, vm.gc.pauseCount, vm.gc.pauseTotal * 1e3, vm.gc.pauseMax * 1e3);
+  fprintf(stderr, "heap: %d pages, %d KB\n", vm.heap.pageCount, vm.heap.pageCount * (GC_PAGE_SIZE / 1024));
+  fprintf(stderr, "large: %d objects, %zu KB, %d cached\n", vm.heap.largeCount, vm.heap.largeBytes / 1024,
+          vm.heap.largeCacheCount);
+  if (!vm.gc.enabled) {
+    fprintf(stderr, "regions: %d, %d KB\n", vm.heap.regionCount, vm.heap.regionCount * (GC_REGION_SIZE / 1024));
+  }
+  for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+    if (vm.gc.pauseHistogram[i] == 0) continue;
+    if (i == 0) {
+      fprintf(stderr, "  %8s < %6d us : %d\n", "", 1, vm.gc.pauseHistogram[i]);
+    } else if (i == GC_PAUSE_BUCKETS - 1) {
+      fprintf(stderr, "  %6d us <= %8s : %d\n", 1 << (i - 1), "", vm.gc.pauseHistogram[i]);
+    } else {
+      fprintf(stderr, "  %6d us .. %6d us : %d\n", 1 << (i - 1), 1 << i, vm.gc.pauseHistogram[i]);
+    }
+  }
+}
+
 void freeObjects() {
   size_t before = vm.bytesAllocated;
-  Object *obj = vm.objects;
-  while (obj != NULL) {
-    Object *next = obj->next;
-    freeObject(obj);
-    obj = next;
-  }
-#ifdef DEBUG_GC
-  printf("      Collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
-#endif
+  for (Region *region = vm.heap.objectRegions; region != NULL; region = region->next) {
+    for (uint8_t *ptr = REGION_START(region); ptr < region->top; ptr += objectSize((Object *)ptr)) {
+      freeObject((Object *)ptr);
+    }
+  }
+  freeRegions(&vm.heap.objectRegions);
+  vm.heap.regionCount = 0;
+  for (int sizeClass = 0; sizeClass < GC_SIZE_CLASSES; sizeClass++) {
+    HeapPage *page = vm.heap.pages[sizeClass];
+    while (page != NULL) {
+      HeapPage *next = page->next;
+      for (int word = 0; word < GC_PAGE_WORDS; word++) {
+        uint64_t live = page->live[word];
+        while (live != 0) {
+          int bit = __builtin_ctzll(live);
+          live &= live - 1;
+          freeObject((Object *)(page->base + ((size_t)word * 64 + bit) * GC_GRANULE));
+        }
+      }
+      free(page->base);
+      free(page);
+      page = next;
+    }
+    vm.heap.pages[sizeClass] = NULL;
+    vm.heap.cursor[sizeClass] = NULL;
+  }
+  while (vm.heap.largeCache != NULL) {
+    LargeObject *next = vm.heap.largeCache->next;
+    munmap(vm.heap.largeCache, vm.heap.largeCache->size);
+    vm.heap.largeCache = next;
+  }
+  vm.heap.largeCacheBytes = 0;
+  vm.heap.largeCacheCount = 0;
+  vm.heap.pageCount = 0;
+  free(vm.young);
+  vm.young = NULL;
+  vm.youngCount = 0;
+  vm.youngCapacity = 0;
+  free(vm.youngStrings);
+  vm.youngStrings = NULL;
+  vm.youngStringCount = 0;
+  vm.youngStringCapacity = 0;
+  free(vm.remembered);
+  if (vm.gc.trace) {
+    printf("      Collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated,
+           vm.nextGC);
+  }
 }
 
 void markValue(Value value) {
@@ -38,13 +456,29 @@ void markValue(Value value) {
 
 void markObject(Object *obj) {
   if (obj == NULL) return;
-  if (obj->isMarked) return;
-#ifdef DEBUG_GC
-  printf("      %p mark ", (void *)obj);
-  printVal(TO_OBJECT(obj));
-  printf("\n");
-#endif
-  obj->isMarked = true;
+  if (vm.gc.minor && obj->isOld) return;
+  _Atomic uint64_t *word = MARK_WORD(obj);
+  uint64_t bit = MARK_BIT(obj);
+  if (atomic_load_explicit(word, memory_order_relaxed) & bit) return;
+  if (atomic_fetch_or_explicit(word, bit, memory_order_acq_rel) & bit) return;
+  if (vm.gc.trace) {
+    printf("      %p mark ", (void *)obj);
+    printVal(TO_OBJECT(obj));
+    printf("\n");
+  }
+  if (markWorker != NULL) {
+    pushWork(markWorker, obj);
+    return;
+  }
+  if (onMarkerThread) {
+    if (vm.gc.markerGrayCapacity < vm.gc.markerGrayCount + 1) {
+      vm.gc.markerGrayCapacity = GROW_CAPACITY(vm.gc.markerGrayCapacity);
+      vm.gc.markerGray = (Object **)realloc(vm.gc.markerGray, sizeof(Object *) * vm.gc.markerGrayCapacity);
+      if (vm.gc.markerGray == NULL) exit(1);
+    }
+    vm.gc.markerGray[vm.gc.markerGrayCount++] = obj;
+    return;
+  }
   if (vm.grayCapacity < vm.grayCount + 1) {
     vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
     vm.grayStack = (Object **)realloc(vm.grayStack, sizeof(Object *) * vm.grayCapacity);
@@ -53,89 +487,335 @@ void markObject(Object *obj) {
   vm.grayStack[vm.grayCount++] = obj;
 }
 
+void rememberObject(Object *obj) {
+  if (obj->isRemembered) return;
+  obj->isRemembered = true;
+  if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+    vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+    vm.remembered = (Object **)realloc(vm.remembered, sizeof(Object *) * vm.rememberedCapacity);
+    if (vm.remembered == NULL) exit(1);
+  }
+  vm.remembered[vm.rememberedCount++] = obj;
+}
+
+void trackYoung(Object *obj) {
+  if (vm.youngCapacity < vm.youngCount + 1) {
+    vm.youngCapacity = GROW_CAPACITY(vm.youngCapacity);
+    vm.young = (Object **)realloc(vm.young, sizeof(Object *) * vm.youngCapacity);
+    if (vm.young == NULL) exit(1);
+  }
+  vm.young[vm.youngCount++] = obj;
+}
+
+void trackYoungString(StringObject *string) {
+  if (vm.youngStringCapacity < vm.youngStringCount + 1) {
+    vm.youngStringCapacity = GROW_CAPACITY(vm.youngStringCapacity);
+    vm.youngStrings = (StringObject **)realloc(vm.youngStrings, sizeof(StringObject *) * vm.youngStringCapacity);
+    if (vm.youngStrings == NULL) exit(1);
+  }
+  vm.youngStrings[vm.youngStringCount++] = string;
+}
+
+void promoteAll() {
+  for (int i = 0; i < vm.youngCount; i++) {
+    vm.young[i]->isOld = true;
+  }
+  vm.youngCount = 0;
+  vm.youngStringCount = 0;
+  for (int i = 0; i < vm.rememberedCount; i++) {
+    vm.remembered[i]->isRemembered = false;
+  }
+  vm.rememberedCount = 0;
+}
+
 void freeObject(Object *obj) {
-#ifdef DEBUG_GC
-  printf("      %p free ObjectType %d\n", (void *)obj, obj->type);
-#endif
+  if (vm.gc.trace) printf("      %p free ObjectType %d\n", (void *)obj, obj->type);
   switch (obj->type) {
-    case CLASS_OBJECT: {
-      FREE(ClassObject, obj);
-      break;
-    }
-    case UPVALUE_OBJECT: {
-      FREE(UpvalueObject, obj);
-      break;
-    }
-    case CLOSURE_OBJECT: {
-      ClosureObject *closure = (ClosureObject *)obj;
-      if (closure->upvalueCount > 0) {
-        DELETE_ARRAY(UpvalueObject *, closure->upvalues, closure->upvalueCount);
-      }
-      FREE(ClosureObject, obj);
+    case CLASS_OBJECT:
+    case UPVALUE_OBJECT:
+    case CLOSURE_OBJECT:
+    case NATIVE_OBJECT:
+    case ROPE_OBJECT:
       break;
-    }
     case FUNCTION_OBJECT: {
       FunctionObject *fx = (FunctionObject *)obj;
+      free(fx->feedback);
+      free(fx->callTargets);
       deleteChunk(&fx->chunk);
-      FREE(FunctionObject, obj);
-      break;
-    }
-    case NATIVE_OBJECT: {
-      FREE(NativeObject, obj);
       break;
     }
     case STRING_OBJECT: {
       StringObject *string = (StringObject *)obj;
-      DELETE_ARRAY(char, string->str, string->length + 1);
-      FREE(StringObject, obj);
+      if (string->storage == STRING_OWNED) DELETE_ARRAY(char, string->str, string->length + 1);
       break;
     }
   }
+  if (vm.gc.enabled) releaseSlot(obj);
+}
+
+void collectGarbage() {
+  double start = gcNow();
+  if (vm.gc.stress) {
+    garbageCollect();
+  } else if (vm.gc.phase != GC_IDLE || vm.bytesAllocated > vm.nextGC) {
+    if (vm.gc.phase == GC_IDLE) beginCycle();
+    collectStep(start + vm.gc.pauseTarget);
+  } else {
+    minorCollect();
+  }
+  recordPause(gcNow() - start);
 }
 
 void garbageCollect() {
-#ifdef DEBUG_GC
-  printf("\n                -- gc begin\n");
-  size_t before = vm.bytesAllocated;
-#endif
-  markRoots();
-  traceRefs();
+  if (vm.gc.phase == GC_IDLE) beginCycle();
+  collectStep(0);
+}
+
+void beginCycle() {
+  if (vm.gc.trace) printf("\n                -- gc begin\n");
+  vm.gc.cycleStart = vm.bytesAllocated;
+  vm.gc.phase = GC_MARK;
+  markRoots(true);
+  if (vm.gc.concurrent && !vm.gc.compiling) startConcurrentMark();
+}
+
+void collectStep(double deadline) {
+  if (vm.gc.phase == GC_MARK) {
+    if (vm.gc.concurrentCycle ? !pollMarker() : !traceRefs(vm.gc.workers > 1 ? 0 : deadline)) {
+      scheduleStep();
+      return;
+    }
+    vm.gc.concurrentCycle = false;
+    finishMark();
+  }
+  if (!sweepPages(deadline)) {
+    scheduleStep();
+    return;
+  }
+  finishCycle();
+}
+
+void scheduleStep() {
+  vm.nextGC = vm.bytesAllocated + GC_STEP_SIZE;
+  vm.gc.youngBytes = 0;
+}
+
+void startConcurrentMark() {
+  if (!vm.gc.markerStarted) {
+    if (pthread_create(&vm.gc.marker, NULL, markerThread, NULL) != 0) return;
+    vm.gc.markerStarted = true;
+  }
+  vm.gc.concurrentCycle = true;
+  pollMarker();
+}
+
+bool pollMarker() {
+  pthread_mutex_lock(&vm.gc.markerLock);
+  bool done = !vm.gc.markerWork;
+  if (done && vm.grayCount > 0) {
+    if (vm.gc.markerGrayCapacity < vm.grayCount) {
+      vm.gc.markerGrayCapacity = vm.grayCount;
+      vm.gc.markerGray = (Object **)realloc(vm.gc.markerGray, sizeof(Object *) * vm.gc.markerGrayCapacity);
+      if (vm.gc.markerGray == NULL) exit(1);
+    }
+    memcpy(vm.gc.markerGray, vm.grayStack, sizeof(Object *) * vm.grayCount);
+    vm.gc.markerGrayCount = vm.grayCount;
+    vm.grayCount = 0;
+    vm.gc.markerWork = true;
+    pthread_cond_signal(&vm.gc.markerWake);
+    done = false;
+  }
+  pthread_mutex_unlock(&vm.gc.markerLock);
+  return done;
+}
+
+void *markerThread(void *arg) {
+  onMarkerThread = true;
+  pthread_mutex_lock(&vm.gc.markerLock);
+  while (true) {
+    while (!vm.gc.markerWork && !vm.gc.markerShutdown) {
+      pthread_cond_wait(&vm.gc.markerWake, &vm.gc.markerLock);
+    }
+    if (vm.gc.markerShutdown) break;
+    pthread_mutex_unlock(&vm.gc.markerLock);
+    drainMarker();
+    pthread_mutex_lock(&vm.gc.markerLock);
+    vm.gc.markerWork = false;
+  }
+  pthread_mutex_unlock(&vm.gc.markerLock);
+  return NULL;
+}
+
+void drainMarker() {
+  bool empty = false;
+  while (!empty) {
+    pthread_mutex_lock(&vm.gc.heapLock);
+    for (int work = 0; work < GC_STEP_WORK && vm.gc.markerGrayCount > 0; work++) {
+      blackenObject(vm.gc.markerGray[--vm.gc.markerGrayCount]);
+    }
+    empty = vm.gc.markerGrayCount == 0;
+    pthread_mutex_unlock(&vm.gc.heapLock);
+  }
+}
+
+void stopMarker() {
+  if (!vm.gc.markerStarted) return;
+  pthread_mutex_lock(&vm.gc.markerLock);
+  vm.gc.markerShutdown = true;
+  pthread_cond_signal(&vm.gc.markerWake);
+  pthread_mutex_unlock(&vm.gc.markerLock);
+  pthread_join(vm.gc.marker, NULL);
+  vm.gc.markerStarted = false;
+  vm.gc.concurrentCycle = false;
+  free(vm.gc.markerGray);
+}
+
+void freeMarkWorkers() {
+  if (vm.gc.markWorkers == NULL) return;
+  pthread_mutex_lock(&vm.gc.poolLock);
+  vm.gc.poolShutdown = true;
+  pthread_cond_broadcast(&vm.gc.poolWake);
+  pthread_mutex_unlock(&vm.gc.poolLock);
+  for (int i = 1; i <= vm.gc.poolThreads; i++) {
+    pthread_join(vm.gc.markWorkers[i].thread, NULL);
+  }
+  vm.gc.poolThreads = 0;
+  for (int i = 0; i < vm.gc.workers; i++) {
+    pthread_mutex_destroy(&vm.gc.markWorkers[i].lock);
+    free(vm.gc.markWorkers[i].items);
+    free(vm.gc.markWorkers[i].local);
+  }
+  free(vm.gc.markWorkers);
+  vm.gc.markWorkers = NULL;
+}
+
+void finishMark() {
+  markRoots(false);
+  traceRefs(0);
   hashTableRemoveWhite(&vm.strings);
-  sweep();
-  vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
-#ifdef DEBUG_GC
-  printf("                -- gc end\n\n");
-  printf("      Collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
-#endif
+  vm.youngStringCount = 0;
+  for (int i = 0; i < vm.rememberedCount; i++) {
+    vm.remembered[i]->isRemembered = false;
+  }
+  vm.rememberedCount = 0;
+  sweepYoung();
+  vm.heap.epoch++;
+  resetCursors();
+  vm.gc.phase = GC_SWEEP;
+  vm.gc.sweepClass = 0;
+  vm.gc.sweepPrev = NULL;
+  vm.gc.sweepPage = vm.heap.pages[0];
 }
 
-void markRoots() {
+void finishCycle() {
+  size_t before = vm.gc.cycleStart;
+  vm.gc.phase = GC_IDLE;
+  vm.gc.youngBytes = 0;
+  paceGC(before);
+  if (vm.gc.trace) {
+    printf("                -- gc end\n\n");
+    printf("      Collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
+  }
+}
+
+void recordPause(double seconds) {
+  double micros = seconds * 1e6;
+  int bucket = 0;
+  while (bucket < GC_PAUSE_BUCKETS - 1 && micros >= (double)(1 << bucket)) bucket++;
+  vm.gc.pauseHistogram[bucket]++;
+  vm.gc.pauseCount++;
+  vm.gc.pauseTotal += seconds;
+  if (seconds > vm.gc.pauseMax) vm.gc.pauseMax = seconds;
+}
+
+double gcNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void minorCollect() {
+  size_t before = vm.bytesAllocated;
+  if (vm.gc.trace) printf("\n                -- minor gc begin\n");
+  vm.gc.minor = true;
+  markRoots(false);
+  for (int i = 0; i < vm.rememberedCount; i++) {
+    Object *obj = vm.remembered[i];
+    if (obj->isOld) {
+      blackenObject(obj);
+    } else {
+      markObject(obj);
+    }
+  }
+  traceRefs(0);
+  pruneYoungStrings();
+  sweepYoung();
+  pruneRemembered();
+  resetCursors();
+  vm.gc.minor = false;
+  vm.gc.youngBytes = 0;
+  vm.gc.minorCollections++;
+  if (vm.gc.trace) {
+    printf("                -- minor gc end\n\n");
+    printf("      Collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
+  }
+}
+
+void paceGC(size_t before) {
+  double survival = before == 0 ? 0 : (double)vm.bytesAllocated / before;
+  if (survival > 1) survival = 1;
+  if (vm.gc.collections++ == 0) {
+    vm.gc.survivalRate = survival;
+  } else {
+    vm.gc.survivalRate = GC_SURVIVAL_WEIGHT * survival + (1 - GC_SURVIVAL_WEIGHT) * vm.gc.survivalRate;
+  }
+  size_t next = (size_t)(vm.bytesAllocated * vm.gc.growthFactor * (1 + vm.gc.survivalRate));
+  if (vm.gc.targetHeap > 0 && next > vm.gc.targetHeap) {
+    next = vm.bytesAllocated < vm.gc.targetHeap ? vm.gc.targetHeap : (size_t)(vm.bytesAllocated * vm.gc.growthFactor);
+  }
+  vm.nextGC = next < vm.gc.minHeap ? vm.gc.minHeap : next;
+}
+
+void markRoots(bool globals) {
   for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {
     markValue(*slot);
+    markObject((Object *)vm.openUpvalues[slot - vm.stack]);
+  }
+  if (globals) {
+    markTable(&vm.globals);
+    for (int i = 0; i < UINT8_COUNT; i++) {
+      markObject((Object *)vm.singleBytes[i]);
+    }
   }
-  markTable(&vm.globals);
   markCompilerRoots();
   for (int i = 0; i < vm.frameCount; i++) {
     markObject((Object *)vm.frames[i].closure);
   }
-  for (UpvalueObject *upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
-    markObject((Object *)upvalue);
-  }
+  markObject((Object *)vm.splitCursor.source);
+  markObject((Object *)vm.splitCursor.separator);
 }
 
-void traceRefs() {
+bool traceRefs(double deadline) {
+  if (deadline == 0 && vm.gc.workers > 1 && !vm.gc.minor && !onMarkerThread &&
+      vm.bytesAllocated > GC_PARALLEL_MIN_HEAP) {
+    parallelTrace();
+    return true;
+  }
+  int work = 0;
   while (vm.grayCount > 0) {
+    if (deadline > 0 && ++work % GC_STEP_WORK == 0 && gcNow() >= deadline) return false;
     Object *obj = vm.grayStack[--vm.grayCount];
     blackenObject(obj);
   }
+  return true;
 }
 
 void blackenObject(Object *obj) {
-#ifdef DEBUG_GC
-  printf("      %p blacken ", (void *)obj);
-  printVal(TO_OBJECT(obj));
-  printf("\n");
-#endif
+  if (vm.gc.trace) {
+    printf("      %p blacken ", (void *)obj);
+    printVal(TO_OBJECT(obj));
+    printf("\n");
+  }
   switch (obj->type) {
     case CLASS_OBJECT: {
       ClassObject *__class__ = (ClassObject *)obj;
@@ -156,11 +836,27 @@ void blackenObject(Object *obj) {
     case FUNCTION_OBJECT: {
       FunctionObject *fx = (FunctionObject *)obj;
       markObject((Object *)fx->name);
+      markObject((Object *)fx->closure);
       markArray(&fx->chunk.constants);
+      if (fx->callTargets != NULL) {
+        for (int i = 0; i < fx->chunk.count; i++) {
+          markObject((Object *)fx->callTargets[i]);
+        }
+      }
+      break;
+    }
+    case ROPE_OBJECT: {
+      RopeObject *rope = (RopeObject *)obj;
+      markObject(rope->left);
+      markObject(rope->right);
+      break;
+    }
+    case STRING_OBJECT: {
+      StringObject *string = (StringObject *)obj;
+      if (string->storage == STRING_VIEW) markObject((Object *)STRING_PARENT(string));
       break;
     }
     case NATIVE_OBJECT:
-    case STRING_OBJECT:
       break;
   }
 }
@@ -171,23 +867,281 @@ void markArray(ValArr *arr) {
   }
 }
 
-void sweep() {
-  Object *prev = NULL;
-  Object *obj = vm.objects;
-  while (obj != NULL) {
-    if (obj->isMarked) {
-      obj->isMarked = false;
-      prev = obj;
-      obj = obj->next;
+bool sweepPages(double deadline) {
+  while (vm.gc.sweepClass < GC_SIZE_CLASSES) {
+    HeapPage *page = vm.gc.sweepPage;
+    while (page != NULL) {
+      if (deadline > 0 && gcNow() >= deadline) {
+        vm.gc.sweepPage = page;
+        return false;
+      }
+      if (page->sweptEpoch != vm.heap.epoch) sweepPage(page);
+      HeapPage *next = page->next;
+      if (page->liveCount == 0 && page != vm.heap.cursor[vm.gc.sweepClass]) {
+        releasePage(vm.gc.sweepPrev, page);
+      } else {
+        vm.gc.sweepPrev = page;
+      }
+      page = next;
+    }
+    vm.gc.sweepClass++;
+    vm.gc.sweepPrev = NULL;
+    vm.gc.sweepPage = vm.gc.sweepClass < GC_SIZE_CLASSES ? vm.heap.pages[vm.gc.sweepClass] : NULL;
+  }
+  return true;
+}
+
+void sweepPage(HeapPage *page) {
+  for (int word = 0; word < GC_PAGE_WORDS; word++) {
+    uint64_t dead = page->live[word] & ~atomic_load_explicit(&page->marks[word], memory_order_relaxed);
+    while (dead != 0) {
+      int bit = __builtin_ctzll(dead);
+      dead &= dead - 1;
+      freeObject((Object *)(page->base + ((size_t)word * 64 + bit) * GC_GRANULE));
+    }
+    atomic_store_explicit(&page->marks[word], 0, memory_order_relaxed);
+  }
+  page->sweptEpoch = vm.heap.epoch;
+  page->allocWord = 0;
+}
+
+void sweepYoung() {
+  int count = 0;
+  for (int i = 0; i < vm.youngCount; i++) {
+    Object *obj = vm.young[i];
+    if (!IS_MARKED(obj)) {
+      freeObject(obj);
+    } else if (!vm.gc.minor) {
+      promoteObject(obj);
     } else {
-      Object *unreachable = obj;
-      obj = obj->next;
-      if (prev != NULL) {
-        prev->next = obj;
+      clearMark(obj);
+      if (++obj->age >= vm.gc.promoteAge) {
+        promoteObject(obj);
       } else {
-        vm.objects = obj;
+        vm.young[count++] = obj;
+      }
+    }
+  }
+  vm.youngCount = count;
+}
+
+void promoteObject(Object *obj) {
+  obj->isOld = true;
+  if (vm.gc.minor && hasYoungRefs(obj)) rememberObject(obj);
+}
+
+void pruneRemembered() {
+  int count = 0;
+  for (int i = 0; i < vm.rememberedCount; i++) {
+    Object *obj = vm.remembered[i];
+    if (!obj->isOld || hasYoungRefs(obj)) {
+      vm.remembered[count++] = obj;
+    } else {
+      obj->isRemembered = false;
+    }
+  }
+  vm.rememberedCount = count;
+}
+
+void pruneYoungStrings() {
+  int count = 0;
+  for (int i = 0; i < vm.youngStringCount; i++) {
+    StringObject *string = vm.youngStrings[i];
+    if (string->obj.isOld) continue;
+    if (IS_MARKED(&string->obj)) {
+      vm.youngStrings[count++] = string;
+    } else {
+      hashTableDeleteValue(&vm.strings, string);
+    }
+  }
+  vm.youngStringCount = count;
+}
+
+bool hasYoungRefs(Object *obj) {
+  switch (obj->type) {
+    case CLASS_OBJECT:
+      return !((ClassObject *)obj)->name->obj.isOld;
+    case UPVALUE_OBJECT:
+      return IS_YOUNG_VALUE(((UpvalueObject *)obj)->closed);
+    case CLOSURE_OBJECT: {
+      ClosureObject *closure = (ClosureObject *)obj;
+      if (!closure->function->obj.isOld) return true;
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        if (closure->upvalues[i] != NULL && !closure->upvalues[i]->obj.isOld) return true;
+      }
+      return false;
+    }
+    case FUNCTION_OBJECT: {
+      FunctionObject *fx = (FunctionObject *)obj;
+      if (fx->name != NULL && !fx->name->obj.isOld) return true;
+      if (fx->closure != NULL && !fx->closure->obj.isOld) return true;
+      for (int i = 0; i < fx->chunk.constants.count; i++) {
+        if (IS_YOUNG_VALUE(fx->chunk.constants.values[i])) return true;
+      }
+      if (fx->callTargets != NULL) {
+        for (int i = 0; i < fx->chunk.count; i++) {
+          if (fx->callTargets[i] != NULL && !fx->callTargets[i]->obj.isOld) return true;
+        }
+      }
+      return false;
+    }
+    case ROPE_OBJECT: {
+      RopeObject *rope = (RopeObject *)obj;
+      return !rope->left->isOld || (rope->right != NULL && !rope->right->isOld);
+    }
+    case STRING_OBJECT: {
+      StringObject *string = (StringObject *)obj;
+      return string->storage == STRING_VIEW && !STRING_PARENT(string)->obj.isOld;
+    }
+    case NATIVE_OBJECT:
+      return false;
+  }
+  return false;
+}
+
+void parallelTrace() {
+  if (vm.gc.markWorkers == NULL) {
+    vm.gc.markWorkers = (MarkWorker *)calloc(vm.gc.workers, sizeof(MarkWorker));
+    if (vm.gc.markWorkers == NULL) exit(1);
+    for (int i = 0; i < vm.gc.workers; i++) {
+      pthread_mutex_init(&vm.gc.markWorkers[i].lock, NULL);
+    }
+  }
+  int share = (vm.grayCount + vm.gc.workers - 1) / vm.gc.workers;
+  for (int i = 0; i < vm.gc.workers && i * share < vm.grayCount; i++) {
+    int count = vm.grayCount - i * share < share ? vm.grayCount - i * share : share;
+    shareWork(&vm.gc.markWorkers[i], vm.grayStack + i * share, count);
+  }
+  vm.grayCount = 0;
+  for (; vm.gc.poolThreads + 1 < vm.gc.workers; vm.gc.poolThreads++) {
+    MarkWorker *worker = &vm.gc.markWorkers[vm.gc.poolThreads + 1];
+    worker->round = vm.gc.poolRound;
+    if (pthread_create(&worker->thread, NULL, markWorkerThread, worker) != 0) break;
+  }
+  atomic_store(&vm.gc.activeWorkers, vm.gc.poolThreads + 1);
+  pthread_mutex_lock(&vm.gc.poolLock);
+  vm.gc.poolRunning = vm.gc.poolThreads;
+  vm.gc.poolRound++;
+  pthread_cond_broadcast(&vm.gc.poolWake);
+  pthread_mutex_unlock(&vm.gc.poolLock);
+  markWork(&vm.gc.markWorkers[0]);
+  pthread_mutex_lock(&vm.gc.poolLock);
+  while (vm.gc.poolRunning > 0) pthread_cond_wait(&vm.gc.poolIdle, &vm.gc.poolLock);
+  pthread_mutex_unlock(&vm.gc.poolLock);
+}
+
+void *markWorkerThread(void *arg) {
+  MarkWorker *self = (MarkWorker *)arg;
+  pthread_mutex_lock(&vm.gc.poolLock);
+  while (true) {
+    while (self->round == vm.gc.poolRound && !vm.gc.poolShutdown) {
+      pthread_cond_wait(&vm.gc.poolWake, &vm.gc.poolLock);
+    }
+    if (vm.gc.poolShutdown) break;
+    self->round = vm.gc.poolRound;
+    pthread_mutex_unlock(&vm.gc.poolLock);
+    markWork(self);
+    pthread_mutex_lock(&vm.gc.poolLock);
+    if (--vm.gc.poolRunning == 0) pthread_cond_signal(&vm.gc.poolIdle);
+  }
+  pthread_mutex_unlock(&vm.gc.poolLock);
+  return NULL;
+}
+
+void markWork(MarkWorker *self) {
+  markWorker = self;
+  while (true) {
+    Object *obj = popWork(self);
+    if (obj == NULL) obj = stealWork(self);
+    if (obj != NULL) {
+      blackenObject(obj);
+      continue;
+    }
+    atomic_fetch_sub(&vm.gc.activeWorkers, 1);
+    while (true) {
+      if (atomic_load(&vm.gc.activeWorkers) == 0) {
+        markWorker = NULL;
+        return;
       }
-      freeObject(unreachable);
+      if (anyWork()) {
+        atomic_fetch_add(&vm.gc.activeWorkers, 1);
+        break;
+      }
+      sched_yield();
     }
   }
 }
+
+void pushWork(MarkWorker *worker, Object *obj) {
+  if (worker->localCapacity < worker->localCount + 1) {
+    worker->localCapacity = GROW_CAPACITY(worker->localCapacity);
+    worker->local = (Object **)realloc(worker->local, sizeof(Object *) * worker->localCapacity);
+    if (worker->local == NULL) exit(1);
+  }
+  worker->local[worker->localCount++] = obj;
+  if (worker->localCount > 1 && atomic_load_explicit(&worker->available, memory_order_relaxed) == 0 &&
+      atomic_load_explicit(&vm.gc.activeWorkers, memory_order_relaxed) < vm.gc.workers) {
+    int half = worker->localCount / 2;
+    shareWork(worker, worker->local, half);
+    memmove(worker->local, worker->local + half, sizeof(Object *) * (worker->localCount - half));
+    worker->localCount -= half;
+  }
+}
+
+void shareWork(MarkWorker *worker, Object **items, int count) {
+  pthread_mutex_lock(&worker->lock);
+  if (worker->top == worker->count) {
+    worker->top = 0;
+    worker->count = 0;
+  }
+  if (worker->capacity < worker->count + count) {
+    while (worker->capacity < worker->count + count) worker->capacity = GROW_CAPACITY(worker->capacity);
+    worker->items = (Object **)realloc(worker->items, sizeof(Object *) * worker->capacity);
+    if (worker->items == NULL) exit(1);
+  }
+  memcpy(worker->items + worker->count, items, sizeof(Object *) * count);
+  worker->count += count;
+  atomic_store_explicit(&worker->available, worker->count - worker->top, memory_order_relaxed);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+int takeWork(MarkWorker *self, MarkWorker *victim, int limit) {
+  pthread_mutex_lock(&victim->lock);
+  int count = victim->count - victim->top;
+  if (count > limit) count = limit;
+  if (count > 0) {
+    if (self->localCapacity < self->localCount + count) {
+      while (self->localCapacity < self->localCount + count) self->localCapacity = GROW_CAPACITY(self->localCapacity);
+      self->local = (Object **)realloc(self->local, sizeof(Object *) * self->localCapacity);
+      if (self->local == NULL) exit(1);
+    }
+    memcpy(self->local + self->localCount, victim->items + victim->top, sizeof(Object *) * count);
+    self->localCount += count;
+    victim->top += count;
+    atomic_store_explicit(&victim->available, victim->count - victim->top, memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&victim->lock);
+  return count;
+}
+
+Object *popWork(MarkWorker *worker) {
+  if (worker->localCount == 0 && takeWork(worker, worker, GC_WORK_BATCH) == 0) return NULL;
+  return worker->local[--worker->localCount];
+}
+
+Object *stealWork(MarkWorker *self) {
+  int index = (int)(self - vm.gc.markWorkers);
+  for (int i = 1; i < vm.gc.workers; i++) {
+    MarkWorker *victim = &vm.gc.markWorkers[(index + i) % vm.gc.workers];
+    int available = atomic_load_explicit(&victim->available, memory_order_relaxed);
+    if (available > 0 && takeWork(self, victim, (available + 1) / 2) > 0) return self->local[--self->localCount];
+  }
+  return NULL;
+}
+
+bool anyWork() {
+  for (int i = 0; i < vm.gc.workers; i++) {
+    if (atomic_load_explicit(&vm.gc.markWorkers[i].available, memory_order_relaxed) > 0) return true;
+  }
+  return false;
+}
@@ -3,7 +3,7 @@
 void printObject(Value val) {
   switch (OBJECT_TYPE(val)) {
     case CLASS_OBJECT:
-      printf("%s", AS_CLASS(val)->name->str);
+      printf("%.*s", AS_CLASS(val)->name->length, AS_CLASS(val)->name->str);
       break;
     case UPVALUE_OBJECT:
       printf("upvalue");
@@ -18,9 +18,26 @@ void printObject(Value val) {
       printFunction(AS_FUNCTION(val));
       break;
     case STRING_OBJECT:
-      printf("%s", AS_CSTRING(val));
+      printf("%.*s", AS_STRING(val)->length, AS_CSTRING(val));
       break;
+    case ROPE_OBJECT:
+      printRope(AS_ROPE(val));
+      break;
+  }
+}
+
+void printRope(RopeObject *rope) {
+  if (rope->right == NULL) {
+    StringObject *flat = (StringObject *)rope->left;
+    printf("%.*s", flat->length, flat->str);
+    return;
   }
+  char *str = (char *)malloc(rope->length + 1);
+  if (str == NULL) exit(1);
+  copyRope(rope, str);
+  str[rope->length] = '\0';
+  printf("%s", str);
+  free(str);
 }
 
 void printFunction(FunctionObject *function) {
@@ -28,40 +45,208 @@ void printFunction(FunctionObject *function) {
     printf("<script>");
     return;
   }
-  printf("<fx %s>", function->name->str);
+  printf("<fx %.*s>", function->name->length, function->name->str);
 }
 
 StringObject *copyString(const char *str, int length) {
   uint32_t hash = hashString(str, length);
   StringObject *interned = hashTableFindString(&vm.strings, str, length, hash);
   if (interned != NULL) return interned;
-  char *allocStr = ALLOCATE(char, length + 1);
-  memcpy(allocStr, str, length);
-  allocStr[length] = '\0';
-  return allocateString(allocStr, length, hash);
+  StringObject *stringObject = newString(str, length);
+  stringObject->obj.hash = hash;
+  return insertString(stringObject);
+}
+
+StringObject *newString(const char *str, int length) {
+  StringObject *stringObject = reserveString(length);
+  memcpy(stringObject->str, str, length);
+  stringObject->str[length] = '\0';
+  return stringObject;
 }
 
-StringObject *getString(char *str, int length) {
+StringObject *staticString(const char *str, int length) {
   uint32_t hash = hashString(str, length);
   StringObject *interned = hashTableFindString(&vm.strings, str, length, hash);
-  if (interned != NULL) {
-    DELETE_ARRAY(char, str, length + 1);
-    return interned;
+  if (interned != NULL) return interned;
+  StringObject *stringObject = allocateString((char *)str, length, STRING_STATIC);
+  stringObject->obj.hash = hash;
+  return insertString(stringObject);
+}
+
+StringObject *sliceString(StringObject *parent, int start, int end) {
+  int length = end - start;
+  if (length == 1) return vm.singleBytes[(uint8_t)parent->str[start]];
+  if (length < SLICE_MIN_LENGTH ||
+      (parent->length > SLICE_RETAIN_MAX && length < parent->length / SLICE_RETAIN_RATIO)) {
+    return newString(parent->str + start, length);
+  }
+  char *str = parent->str + start;
+  if (parent->storage == STRING_VIEW) parent = STRING_PARENT(parent);
+  push(TO_OBJECT(parent));
+  StringObject *stringObject = allocateString(str, length, STRING_VIEW);
+  STRING_PARENT(stringObject) = parent;
+  pop();
+  return stringObject;
+}
+
+bool stringsEqual(StringObject *a, StringObject *b) {
+  if ((a->interned && b->interned) || a->length != b->length) return false;
+  return memcmp(a->str, b->str, a->length) == 0;
+}
+
+StringObject *formatString(Value *parts, int count) {
+  char numbers[UINT8_COUNT][FORMAT_NUMBER_MAX];
+  int lengths[UINT8_COUNT];
+  int length = 0;
+  for (int i = 0; i < count; i++) {
+    Value part = parts[i];
+    switch (part.type) {
+      case _BOOLEAN:
+        lengths[i] = AS_BOOL(part) ? 4 : 5;
+        break;
+      case _NULL:
+        lengths[i] = 4;
+        break;
+      case _NUMBER:
+        lengths[i] = snprintf(numbers[i], FORMAT_NUMBER_MAX, "%lg", AS_NUMBER(part));
+        break;
+      case _INTEGER:
+        lengths[i] = integerLength(AS_INTEGER(part));
+        break;
+      case _OBJECT:
+        if (!IS_TEXT(part)) return NULL;
+        lengths[i] = textLength(AS_OBJECT(part));
+        break;
+    }
+    length += lengths[i];
+  }
+  if (count == 1 && IS_STRING(parts[0])) return AS_STRING(parts[0]);
+  StringObject *stringObject = reserveString(length);
+  char *str = stringObject->str;
+  for (int i = 0; i < count; i++) {
+    Value part = parts[i];
+    switch (part.type) {
+      case _BOOLEAN:
+        memcpy(str, AS_BOOL(part) ? "true" : "false", lengths[i]);
+        break;
+      case _NULL:
+        memcpy(str, "null", lengths[i]);
+        break;
+      case _NUMBER:
+        memcpy(str, numbers[i], lengths[i]);
+        break;
+      case _INTEGER:
+        writeInteger(AS_INTEGER(part), str + lengths[i]);
+        break;
+      case _OBJECT:
+        if (IS_STRING(part)) {
+          memcpy(str, AS_CSTRING(part), lengths[i]);
+        } else {
+          copyRope(AS_ROPE(part), str);
+        }
+        break;
+    }
+    str += lengths[i];
+  }
+  *str = '\0';
+  return stringObject;
+}
+
+int integerLength(int64_t value) {
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  int length = value < 0 ? 2 : 1;
+  while (magnitude >= 10) {
+    magnitude /= 10;
+    length++;
   }
-  return allocateString(str, length, hash);
+  return length;
 }
 
-StringObject *allocateString(char *str, int length, uint32_t hash) {
-  StringObject *stringObject = ALLOCATE_OBJECT(StringObject, STRING_OBJECT);
+void writeInteger(int64_t value, char *end) {
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  do {
+    *--end = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0) *--end = '-';
+}
+
+StringObject *reserveString(int length) {
+  char *str = length > STRING_INLINE_MAX ? ALLOCATE(char, length + 1) : NULL;
+  return allocateString(str, length, str != NULL ? STRING_OWNED : STRING_INLINE);
+}
+
+StringObject *allocateString(char *str, int length, StringStorage storage) {
+  size_t size = sizeof(StringObject);
+  if (storage == STRING_INLINE) size += length + 1;
+  if (storage == STRING_VIEW) size += sizeof(StringObject *);
+  StringObject *stringObject = (StringObject *)allocateObject(size, STRING_OBJECT);
   stringObject->length = length;
-  stringObject->str = str;
-  stringObject->hash = hash;
+  stringObject->storage = storage;
+  stringObject->interned = false;
+  stringObject->str = storage == STRING_INLINE ? stringObject->chars : str;
+  return stringObject;
+}
+
+StringObject *insertString(StringObject *stringObject) {
+  stringObject->interned = true;
+  if (!stringObject->obj.isOld) trackYoungString(stringObject);
   push(TO_OBJECT(stringObject));
   hashTableInsertValue(&vm.strings, stringObject, TO_NULL);
   pop();
   return stringObject;
 }
 
+RopeObject *newRope(Object *left, Object *right) {
+  RopeObject *rope = ALLOCATE_OBJECT(RopeObject, ROPE_OBJECT);
+  rope->length = textLength(left) + textLength(right);
+  rope->left = left;
+  rope->right = right;
+  return rope;
+}
+
+StringObject *flattenRope(RopeObject *rope) {
+  if (rope->right == NULL) return (StringObject *)rope->left;
+  push(TO_OBJECT(rope));
+  StringObject *flat = reserveString(rope->length);
+  copyRope(rope, flat->str);
+  flat->str[rope->length] = '\0';
+  BEGIN_HEAP_WRITE();
+  rope->left = (Object *)flat;
+  rope->right = NULL;
+  WRITE_BARRIER(rope, TO_OBJECT(flat));
+  END_HEAP_WRITE();
+  pop();
+  return flat;
+}
+
+void copyRope(RopeObject *rope, char *str) {
+  int count = 0;
+  int capacity = GROW_CAPACITY(0);
+  Object **pending = (Object **)malloc(sizeof(Object *) * capacity);
+  if (pending == NULL) exit(1);
+  char *end = str + rope->length;
+  pending[count++] = (Object *)rope;
+  while (count > 0) {
+    Object *node = pending[--count];
+    if (node->type == STRING_OBJECT) {
+      StringObject *string = (StringObject *)node;
+      end -= string->length;
+      memcpy(end, string->str, string->length);
+      continue;
+    }
+    if (capacity < count + 2) {
+      capacity = GROW_CAPACITY(capacity);
+      pending = (Object **)realloc(pending, sizeof(Object *) * capacity);
+      if (pending == NULL) exit(1);
+    }
+    RopeObject *inner = (RopeObject *)node;
+    pending[count++] = inner->left;
+    if (inner->right != NULL) pending[count++] = inner->right;
+  }
+  free(pending);
+}
+
 ClassObject *newClass(StringObject *name) {
   ClassObject *__class__ = ALLOCATE_OBJECT(ClassObject, CLASS_OBJECT);
   __class__->name = name;
@@ -73,6 +258,11 @@ FunctionObject *newFunction() {
   fx->arity = 0;
   fx->upvalueCount = 0;
   fx->name = NULL;
+  fx->closure = NULL;
+  fx->maxStack = 0;
+  fx->codeHash = 0;
+  fx->feedback = NULL;
+  fx->callTargets = NULL;
   initChunk(&fx->chunk);
   return fx;
 }
@@ -87,18 +277,13 @@ UpvalueObject *newUpvalue(Value *slot) {
   UpvalueObject *upvalue = ALLOCATE_OBJECT(UpvalueObject, UPVALUE_OBJECT);
   upvalue->loc = slot;
   upvalue->closed = TO_NULL;
-  upvalue->next = NULL;
   return upvalue;
 }
 
 ClosureObject *newClosure(FunctionObject *fx) {
-  UpvalueObject **upvalues = ALLOCATE_OBJECT(UpvalueObject *, fx->upvalueCount);
-  for (int i = 0; i < fx->upvalueCount; i++) {
-    upvalues[i] = NULL;
-  }
-  ClosureObject *closure = ALLOCATE_OBJECT(ClosureObject, CLOSURE_OBJECT);
+  ClosureObject *closure =
+      (ClosureObject *)allocateObject(sizeof(ClosureObject) + sizeof(UpvalueObject *) * fx->upvalueCount, CLOSURE_OBJECT);
   closure->function = fx;
-  closure->upvalues = upvalues;
   closure->upvalueCount = fx->upvalueCount;
   for (int i = 0; i < closure->upvalueCount; i++) {
     closure->upvalues[i] = NULL;
@@ -107,22 +292,72 @@ ClosureObject *newClosure(FunctionObject *fx) {
 }
 
 Object *allocateObject(size_t size, ObjectType type) {
-  Object *object = (Object *)reallocate(NULL, 0, size);
+  Object *object = allocateSlot(size);
   object->type = type;
-  object->isMarked = false;
-  object->next = vm.objects;
-  vm.objects = object;
-#ifdef DEBUG_GC
-  printf("      %p allocated %zu bytes for ObjectType %d\n", (void *)object, size, type);
-#endif
+  object->isOld = !vm.gc.enabled;
+  object->isRemembered = false;
+  object->age = 0;
+  object->hash = 0;
+  if (vm.gc.enabled) trackYoung(object);
+  if (vm.gc.trace) printf("      %p allocated %zu bytes for ObjectType %d\n", (void *)object, size, type);
   return object;
 }
 
 uint32_t hashString(const char *str, int length) {
-  uint32_t hash = 2166136261u;
-  for (int i = 0; i < length; i++) {
-    hash ^= (uint8_t)str[i];
-    hash *= 16777619;
+  const uint8_t *bytes = (const uint8_t *)str;
+  size_t remaining = (size_t)length;
+  uint64_t seed = vm.hashSeed ^ hashMix(vm.hashSeed ^ HASH_SECRET0, HASH_SECRET1);
+  uint64_t a, b;
+  if (remaining <= 16) {
+    if (remaining >= 4) {
+      size_t shift = (remaining >> 3) << 2;
+      a = (readHalf(bytes) << 32) | readHalf(bytes + shift);
+      b = (readHalf(bytes + remaining - 4) << 32) | readHalf(bytes + remaining - 4 - shift);
+    } else if (remaining > 0) {
+      a = ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[remaining >> 1] << 8) | bytes[remaining - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    if (remaining > 48) {
+      uint64_t seed1 = seed;
+      uint64_t seed2 = seed;
+      do {
+        seed = hashMix(readWord(bytes) ^ HASH_SECRET1, readWord(bytes + 8) ^ seed);
+        seed1 = hashMix(readWord(bytes + 16) ^ HASH_SECRET2, readWord(bytes + 24) ^ seed1);
+        seed2 = hashMix(readWord(bytes + 32) ^ HASH_SECRET3, readWord(bytes + 40) ^ seed2);
+        bytes += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (remaining > 16) {
+      seed = hashMix(readWord(bytes) ^ HASH_SECRET1, readWord(bytes + 8) ^ seed);
+      bytes += 16;
+      remaining -= 16;
+    }
+    a = readWord(bytes + remaining - 16);
+    b = readWord(bytes + remaining - 8);
   }
-  return hash;
+  uint64_t hash = hashMix(a ^ HASH_SECRET1, b ^ seed);
+  hash = hashMix(hash ^ HASH_SECRET0 ^ (uint64_t)length, hash ^ HASH_SECRET1);
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+uint64_t hashMix(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t readWord(const uint8_t *bytes) {
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+uint64_t readHalf(const uint8_t *bytes) {
+  uint32_t half;
+  memcpy(&half, bytes, sizeof(half));
+  return half;
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "profile.h"
+
+void recordBinaryFeedback(FunctionObject *fx, int offset, Value a, Value b) {
+  uint8_t bits;
+  if (IS_INTEGER(a) && IS_INTEGER(b)) {
+    bits = FEEDBACK_INTEGER;
+  } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+    bits = FEEDBACK_NUMBER;
+  } else if (IS_NUMERIC(a) && IS_NUMERIC(b)) {
+    bits = FEEDBACK_MIXED;
+  } else {
+    bits = FEEDBACK_OTHER;
+  }
+  recordFeedback(fx, offset, bits);
+}
+
+void recordCallFeedback(FunctionObject *fx, int offset, Value callee) {
+  uint8_t bits = FEEDBACK_OTHER;
+  if (IS_OBJECT(callee)) {
+    if (OBJECT_TYPE(callee) == CLOSURE_OBJECT) {
+      FunctionObject *target = AS_CLOSURE(callee)->function;
+      if (fx->callTargets == NULL || fx->callTargets[offset] == NULL) setCallTarget(fx, offset, target);
+      bits = fx->callTargets[offset] == target ? FEEDBACK_CLOSURE : FEEDBACK_CLOSURE | FEEDBACK_POLYMORPHIC;
+    }
+    if (OBJECT_TYPE(callee) == NATIVE_OBJECT) bits = FEEDBACK_NATIVE;
+  }
+  recordFeedback(fx, offset, bits);
+}
+
+void setCallTarget(FunctionObject *fx, int offset, FunctionObject *target) {
+  BEGIN_HEAP_WRITE();
+  if (fx->callTargets == NULL) {
+    fx->callTargets = (FunctionObject **)calloc(fx->chunk.count, sizeof(FunctionObject *));
+    if (fx->callTargets == NULL) exit(1);
+  }
+  fx->callTargets[offset] = target;
+  WRITE_BARRIER(fx, TO_OBJECT(target));
+  END_HEAP_WRITE();
+}
+
+void recordFeedback(FunctionObject *fx, int offset, uint8_t bits) {
+  if (fx->feedback == NULL) {
+    fx->feedback = (uint8_t *)calloc(fx->chunk.count, sizeof(uint8_t));
+    if (fx->feedback == NULL) exit(1);
+  }
+  fx->feedback[offset] |= bits;
+}
+
+void applyProfile(FunctionObject *fx) {
+  int count = 0;
+  int capacity = 0;
+  FunctionObject **functions = NULL;
+  gatherFunctions(fx, &functions, &count, &capacity);
+  for (int i = 0; i < count; i++) {
+    quickenFunction(functions[i], functions, count);
+  }
+  free(functions);
+}
+
+void collectProfile(FunctionObject *fx) {
+  Chunk *chunk = &fx->chunk;
+  Profile *profile = NULL;
+  for (int offset = 0; offset < chunk->count; offset += instructionSize(chunk, offset)) {
+    uint8_t bits = feedbackOf(chunk->code[offset]);
+    if (fx->feedback != NULL) bits |= fx->feedback[offset];
+    if (bits == 0) continue;
+    if (profile == NULL) {
+      profile = findProfile(fx->codeHash, chunk->count);
+      if (profile == NULL) profile = addProfile(fx->codeHash, chunk->count);
+    }
+    if (fx->callTargets != NULL && fx->callTargets[offset] != NULL) {
+      bits |= mergeTarget(profile, offset, fx->callTargets[offset]->codeHash);
+    }
+    profile->feedback[offset] |= bits;
+  }
+  for (int i = 0; i < chunk->constants.count; i++) {
+    if (IS_FUNCTION(chunk->constants.values[i])) collectProfile(AS_FUNCTION(chunk->constants.values[i]));
+  }
+}
+
+void deleteProfiles() {
+  for (int i = 0; i < vm.profileCount; i++) {
+    free(vm.profiles[i].feedback);
+    free(vm.profiles[i].targets);
+  }
+  free(vm.profiles);
+  vm.profiles = NULL;
+  vm.profileCount = 0;
+  vm.profileCapacity = 0;
+}
+
+bool loadProfile(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) return false;
+  int version;
+  if (fscanf(file, PROFILE_MAGIC " %d", &version) != 1 || version != PROFILE_VERSION) {
+    fclose(file);
+    return false;
+  }
+  uint64_t hash;
+  int codeLength, siteCount;
+  while (fscanf(file, " fx %" SCNx64 " %d %d", &hash, &codeLength, &siteCount) == 3) {
+    if (codeLength <= 0 || codeLength > UINT16_MAX * 16 || siteCount < 0) break;
+    Profile *profile = findProfile(hash, codeLength);
+    if (profile == NULL) profile = addProfile(hash, codeLength);
+    for (int i = 0; i < siteCount; i++) {
+      int offset;
+      unsigned int bits;
+      uint64_t target;
+      if (fscanf(file, " %d:%x:%" SCNx64, &offset, &bits, &target) != 3) break;
+      if (offset < 0 || offset >= codeLength) continue;
+      if (target != 0) bits |= mergeTarget(profile, offset, target);
+      profile->feedback[offset] |= (uint8_t)bits;
+    }
+  }
+  bool ok = feof(file);
+  fclose(file);
+  return ok;
+}
+
+bool saveProfile(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) return false;
+  fprintf(file, PROFILE_MAGIC " %d\n", PROFILE_VERSION);
+  for (int i = 0; i < vm.profileCount; i++) {
+    Profile *profile = &vm.profiles[i];
+    int siteCount = 0;
+    for (int offset = 0; offset < profile->codeLength; offset++) {
+      if (profile->feedback[offset] != 0) siteCount++;
+    }
+    fprintf(file, "fx %016" PRIx64 " %d %d\n", profile->hash, profile->codeLength, siteCount);
+    for (int offset = 0; offset < profile->codeLength; offset++) {
+      if (profile->feedback[offset] == 0) continue;
+      uint64_t target = profile->targets != NULL ? profile->targets[offset] : 0;
+      fprintf(file, "  %d:%x:%016" PRIx64 "\n", offset, profile->feedback[offset], target);
+    }
+  }
+  return fclose(file) == 0;
+}
+
+uint8_t quickenedOp(uint8_t op, uint8_t bits) {
+  if (bits == FEEDBACK_INTEGER || bits == FEEDBACK_NUMBER) {
+    bool isInt = bits == FEEDBACK_INTEGER;
+    switch (op) {
+      case OP_ADD:
+        return isInt ? OP_ADD_INT : OP_ADD_NUM;
+      case OP_SUBTRACT:
+        return isInt ? OP_SUBTRACT_INT : OP_SUBTRACT_NUM;
+      case OP_MULTIPLY:
+        return isInt ? OP_MULTIPLY_INT : OP_MULTIPLY_NUM;
+      case OP_LESS:
+        return isInt ? OP_LESS_INT : OP_LESS_NUM;
+      case OP_LESS_EQUAL:
+        return isInt ? OP_LESS_EQUAL_INT : OP_LESS_EQUAL_NUM;
+      case OP_GREATER:
+        return isInt ? OP_GREATER_INT : OP_GREATER_NUM;
+      case OP_GREATER_EQUAL:
+        return isInt ? OP_GREATER_EQUAL_INT : OP_GREATER_EQUAL_NUM;
+    }
+  }
+  if (op == OP_CALL && (bits & ~FEEDBACK_POLYMORPHIC) == FEEDBACK_CLOSURE) return OP_CALL_CLOSURE;
+  if (op == OP_CALL && bits == FEEDBACK_NATIVE) return OP_CALL_NATIVE;
+  return op;
+}
+
+uint8_t feedbackOf(uint8_t op) {
+  switch (op) {
+    case OP_ADD_INT:
+    case OP_SUBTRACT_INT:
+    case OP_MULTIPLY_INT:
+    case OP_LESS_INT:
+    case OP_LESS_EQUAL_INT:
+    case OP_GREATER_INT:
+    case OP_GREATER_EQUAL_INT:
+      return FEEDBACK_INTEGER;
+    case OP_ADD_NUM:
+    case OP_SUBTRACT_NUM:
+    case OP_MULTIPLY_NUM:
+    case OP_LESS_NUM:
+    case OP_LESS_EQUAL_NUM:
+    case OP_GREATER_NUM:
+    case OP_GREATER_EQUAL_NUM:
+      return FEEDBACK_NUMBER;
+    case OP_CALL_CLOSURE:
+    case OP_CALL_TARGET:
+      return FEEDBACK_CLOSURE;
+    case OP_CALL_NATIVE:
+      return FEEDBACK_NATIVE;
+    default:
+      return 0;
+  }
+}
+
+Profile *findProfile(uint64_t hash, int codeLength) {
+  for (int i = 0; i < vm.profileCount; i++) {
+    if (vm.profiles[i].hash == hash && vm.profiles[i].codeLength == codeLength) return &vm.profiles[i];
+  }
+  return NULL;
+}
+
+Profile *addProfile(uint64_t hash, int codeLength) {
+  if (vm.profileCapacity < vm.profileCount + 1) {
+    vm.profileCapacity = GROW_CAPACITY(vm.profileCapacity);
+    vm.profiles = (Profile *)realloc(vm.profiles, sizeof(Profile) * vm.profileCapacity);
+    if (vm.profiles == NULL) exit(1);
+  }
+  Profile *profile = &vm.profiles[vm.profileCount++];
+  profile->hash = hash;
+  profile->codeLength = codeLength;
+  profile->feedback = (uint8_t *)calloc(codeLength, sizeof(uint8_t));
+  if (profile->feedback == NULL) exit(1);
+  profile->targets = NULL;
+  return profile;
+}
+
+uint8_t mergeTarget(Profile *profile, int offset, uint64_t hash) {
+  if (profile->targets == NULL) {
+    profile->targets = (uint64_t *)calloc(profile->codeLength, sizeof(uint64_t));
+    if (profile->targets == NULL) exit(1);
+  }
+  if (profile->targets[offset] == 0) profile->targets[offset] = hash;
+  return profile->targets[offset] == hash ? 0 : FEEDBACK_POLYMORPHIC;
+}
+
+void gatherFunctions(FunctionObject *fx, FunctionObject ***functions, int *count, int *capacity) {
+  if (*capacity < *count + 1) {
+    *capacity = GROW_CAPACITY(*capacity);
+    *functions = (FunctionObject **)realloc(*functions, sizeof(FunctionObject *) * *capacity);
+    if (*functions == NULL) exit(1);
+  }
+  (*functions)[(*count)++] = fx;
+  for (int i = 0; i < fx->chunk.constants.count; i++) {
+    Value constant = fx->chunk.constants.values[i];
+    if (IS_FUNCTION(constant)) gatherFunctions(AS_FUNCTION(constant), functions, count, capacity);
+  }
+}
+
+void quickenFunction(FunctionObject *fx, FunctionObject **functions, int count) {
+  Chunk *chunk = &fx->chunk;
+  Profile *profile = findProfile(fx->codeHash, chunk->count);
+  if (profile == NULL) return;
+  for (int offset = 0; offset < chunk->count; offset += instructionSize(chunk, offset)) {
+    uint8_t bits = profile->feedback[offset];
+    uint8_t op = quickenedOp(chunk->code[offset], bits);
+    if (op == OP_CALL_CLOSURE && bits == FEEDBACK_CLOSURE && profile->targets != NULL) {
+      FunctionObject *target = findTarget(functions, count, profile->targets[offset]);
+      if (target != NULL && target->arity == chunk->code[offset + 1]) {
+        setCallTarget(fx, offset, target);
+        op = OP_CALL_TARGET;
+      }
+    }
+    chunk->code[offset] = op;
+  }
+}
+
+FunctionObject *findTarget(FunctionObject **functions, int count, uint64_t hash) {
+  FunctionObject *target = NULL;
+  if (hash == 0) return NULL;
+  for (int i = 0; i < count; i++) {
+    if (functions[i]->codeHash != hash) continue;
+    if (target != NULL) return NULL;
+    target = functions[i];
+  }
+  return target;
+}
@@ -4,6 +4,7 @@ void initScanner(const char *source) {
   scanner.start = source;
   scanner.current = source;
   scanner.line = 1;
+  scanner.interpolations = 0;
 }
 
 void ignoreWhiteSpaceAndComments() {
@@ -47,6 +48,10 @@ bool isDigit(char c) {
   return c >= '0' && c <= '9';
 }
 
+bool isHexDigit(char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
 bool isAlpha(char c) {
   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '@';
 }
@@ -71,8 +76,16 @@ Token scanToken() {
     case ')':
       return makeToken(TOKEN_RIGHT_PAREN);
     case '{':
+      if (scanner.interpolations > 0) scanner.braces[scanner.interpolations - 1]++;
       return makeToken(TOKEN_LEFT_BRACE);
     case '}':
+      if (scanner.interpolations > 0) {
+        if (scanner.braces[scanner.interpolations - 1] == 0) {
+          scanner.interpolations--;
+          return stringToken();
+        }
+        scanner.braces[scanner.interpolations - 1]--;
+      }
       return makeToken(TOKEN_RIGHT_BRACE);
     case ',':
       return makeToken(TOKEN_COMMA);
@@ -137,6 +150,13 @@ Token errorToken(const char *message) {
 Token stringToken() {
   while (peek() != '"' && !isAtEnd()) {
     if (peek() == '\n') scanner.line++;
+    if (peek() == '$' && peekNext() == '{') {
+      if (scanner.interpolations == INTERPOLATION_MAX) return errorToken("Interpolation nested too deeply.");
+      advanceScanner();
+      advanceScanner();
+      scanner.braces[scanner.interpolations++] = 0;
+      return makeToken(TOKEN_INTERPOLATION);
+    }
     advanceScanner();
   }
   if (isAtEnd()) return errorToken("Unterminated string.");
@@ -145,6 +165,12 @@ Token stringToken() {
 }
 
 Token numberToken() {
+  if (scanner.start[0] == '0' && (peek() == 'x' || peek() == 'b')) {
+    bool hex = advanceScanner() == 'x';
+    while (hex ? isHexDigit(peek()) : (peek() == '0' || peek() == '1')) advanceScanner();
+    if (scanner.current - scanner.start == 2) return errorToken("Expected digits after integer prefix.");
+    return makeToken(TOKEN_NUMBER);
+  }
   while (isDigit(peek())) advanceScanner();
   if (peek() == '.' && isDigit(peekNext())) {
     advanceScanner();
@@ -176,10 +202,11 @@ TokenType identifierType() {
               case 't':
                 return checkKeyword(3, 2, "ch", TOKEN_CATCH);
             }
+            break;
           case 'o':
             if (scanner.start[2] == 'n') {
               if (scanner.start[3] == 't') {
-                return TOKEN_CONT;
+                return checkKeyword(3, 1, "t", TOKEN_CONT);
               } else {
                 return checkKeyword(3, 2, "st", TOKEN_CONST);
               }
@@ -336,6 +363,9 @@ TokenType identifierType() {
               case 'u':
                 return checkKeyword(3, 1, "e", TOKEN_TRUE);
             }
+            break;
+          case 'o':
+            return checkKeyword(2, 0, "", TOKEN_TO);
           case 'y':
             return checkKeyword(2, 4, "peOf", TOKEN_TYPE_OF);
         }
@@ -0,0 +1,103 @@
+#include "search.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_AVX2
+#endif
+
+#define SEARCH_SSE2_WIDTH 16
+#define SEARCH_AVX2_WIDTH 32
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef SEARCH_AVX2
+#include <immintrin.h>
+#endif
+
+static int searchScalar(const char *, int, const char *, int);
+#ifdef __SSE2__
+static int searchSSE2(const char *, int, const char *, int);
+#endif
+#ifdef SEARCH_AVX2
+static int searchAVX2(const char *, int, const char *, int) __attribute__((target("avx2")));
+#endif
+
+static SearchFx searchImpl = searchScalar;
+
+void initSearch() {
+#ifdef __SSE2__
+  searchImpl = searchSSE2;
+#endif
+#ifdef SEARCH_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) searchImpl = searchAVX2;
+#endif
+}
+
+int searchString(const char *haystack, int length, const char *needle, int needleLength) {
+  if (needleLength == 0) return 0;
+  if (needleLength > length) return -1;
+  if (needleLength == 1) {
+    const char *found = memchr(haystack, needle[0], length);
+    return found == NULL ? -1 : (int)(found - haystack);
+  }
+  return searchImpl(haystack, length, needle, needleLength);
+}
+
+int searchScalar(const char *haystack, int length, const char *needle, int needleLength) {
+  if (needleLength > length) return -1;
+  const char *cursor = haystack;
+  const char *end = haystack + length - needleLength + 1;
+  while (cursor < end) {
+    cursor = memchr(cursor, needle[0], end - cursor);
+    if (cursor == NULL) return -1;
+    if (cursor[needleLength - 1] == needle[needleLength - 1] &&
+        memcmp(cursor + 1, needle + 1, needleLength - 2) == 0) {
+      return (int)(cursor - haystack);
+    }
+    cursor++;
+  }
+  return -1;
+}
+
+#ifdef __SSE2__
+int searchSSE2(const char *haystack, int length, const char *needle, int needleLength) {
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+  int offset = 0;
+  for (; offset + needleLength - 1 + SEARCH_SSE2_WIDTH <= length; offset += SEARCH_SSE2_WIDTH) {
+    __m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + offset));
+    __m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + offset + needleLength - 1));
+    uint32_t bits = (uint32_t)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+    while (bits != 0) {
+      int candidate = offset + __builtin_ctz(bits);
+      if (memcmp(haystack + candidate + 1, needle + 1, needleLength - 2) == 0) return candidate;
+      bits &= bits - 1;
+    }
+  }
+  int found = searchScalar(haystack + offset, length - offset, needle, needleLength);
+  return found < 0 ? -1 : offset + found;
+}
+#endif
+
+#ifdef SEARCH_AVX2
+int searchAVX2(const char *haystack, int length, const char *needle, int needleLength) {
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+  int offset = 0;
+  for (; offset + needleLength - 1 + SEARCH_AVX2_WIDTH <= length; offset += SEARCH_AVX2_WIDTH) {
+    __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + offset));
+    __m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + offset + needleLength - 1));
+    uint32_t bits = (uint32_t)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+    while (bits != 0) {
+      int candidate = offset + __builtin_ctz(bits);
+      if (memcmp(haystack + candidate + 1, needle + 1, needleLength - 2) == 0) return candidate;
+      bits &= bits - 1;
+    }
+  }
+  int found = searchScalar(haystack + offset, length - offset, needle, needleLength);
+  return found < 0 ? -1 : offset + found;
+}
+#endif
@@ -32,6 +32,9 @@ void printVal(Value val) {
     case _NUMBER:
       printf("%lg", AS_NUMBER(val));
       break;
+    case _INTEGER:
+      printf("%" PRId64, AS_INTEGER(val));
+      break;
     case _OBJECT:
       printObject(val);
       break;
@@ -39,16 +42,22 @@ void printVal(Value val) {
 }
 
 bool isEqual(Value a, Value b) {
-  if (a.type != b.type) return false;
+  if (a.type != b.type) {
+    if (IS_NUMERIC(a) && IS_NUMERIC(b)) return AS_DOUBLE(a) == AS_DOUBLE(b);
+    return false;
+  }
   switch (a.type) {
     case _BOOLEAN:
       return AS_BOOL(a) == AS_BOOL(b);
     case _NUMBER:
       return AS_NUMBER(a) == AS_NUMBER(b);
+    case _INTEGER:
+      return AS_INTEGER(a) == AS_INTEGER(b);
     case _NULL:
       return true;
     case _OBJECT: {
-      return AS_OBJECT(a) == AS_OBJECT(b);
+      if (AS_OBJECT(a) == AS_OBJECT(b)) return true;
+      return IS_STRING(a) && IS_STRING(b) && stringsEqual(AS_STRING(a), AS_STRING(b));
     }
     default:
       return false;
@@ -0,0 +1,221 @@
+#include "verifier.h"
+
+bool verifyFunction(FunctionObject *fx) {
+  Chunk *chunk = &fx->chunk;
+  for (int i = 0; i < chunk->constants.count; i++) {
+    Value constant = chunk->constants.values[i];
+    if (IS_FUNCTION(constant) && !verifyFunction(AS_FUNCTION(constant))) return false;
+  }
+  if (chunk->count == 0) return verifyError(fx, 0, "Empty chunk");
+  bool *boundary = malloc(sizeof(bool) * chunk->count);
+  int *depth = malloc(sizeof(int) * chunk->count);
+  int *worklist = malloc(sizeof(int) * chunk->count);
+  if (boundary == NULL || depth == NULL || worklist == NULL) exit(1);
+  bool ok = verifyLayout(fx, boundary);
+  int maxStack = fx->arity + 1;
+  int pending = 0;
+  if (ok) {
+    for (int i = 0; i < chunk->count; i++) depth[i] = -1;
+    ok = mergeDepth(fx, depth, worklist, &pending, 0, fx->arity + 1, boundary);
+  }
+  while (ok && pending > 0) {
+    int offset = worklist[--pending];
+    uint8_t instr = chunk->code[offset];
+    int size = instructionSize(chunk, offset);
+    int next = offset + size;
+    int needed;
+    int effect = stackEffect(instr, size > 1 ? chunk->code[offset + 1] : 0, &needed);
+    int cur = depth[offset];
+    if (cur < needed) {
+      ok = verifyError(fx, offset, "Stack underflow");
+      break;
+    }
+    if (!verifyOperands(fx, offset, cur)) {
+      ok = false;
+      break;
+    }
+    int peak = cur + (effect > 0 ? effect : 0);
+    if (instr >= OP_SQRT && instr <= OP_POW) peak = cur + 1;
+    if (peak > maxStack) maxStack = peak;
+    if (instr == OP_RETURN) continue;
+    int target = -1;
+    if (instr == OP_JMP || instr == OP_JMP_IF_FALSE || instr == OP_LOOP || instr == OP_FOR_PREP ||
+        instr == OP_FOR_RANGE) {
+      uint16_t jump = (uint16_t)((chunk->code[next - 2] << 8) | chunk->code[next - 1]);
+      target = (instr == OP_LOOP || instr == OP_FOR_RANGE) ? next - jump : next + jump;
+      if (!mergeDepth(fx, depth, worklist, &pending, target, cur + effect, boundary)) {
+        ok = false;
+        break;
+      }
+    }
+    if (instr == OP_JMP || instr == OP_LOOP) continue;
+    if (next >= chunk->count) {
+      ok = verifyError(fx, offset, "Execution falls off the end of the chunk");
+      break;
+    }
+    ok = mergeDepth(fx, depth, worklist, &pending, next, cur + effect, boundary);
+  }
+  free(worklist);
+  free(depth);
+  free(boundary);
+  if (ok) fx->maxStack = maxStack;
+  return ok;
+}
+
+bool verifyError(FunctionObject *fx, int offset, const char *message) {
+  fprintf(stderr, "[offset %d] Verification Error in %.*s : %s\n", offset, fx->name == NULL ? 6 : fx->name->length,
+          fx->name == NULL ? "script" : fx->name->str, message);
+  return false;
+}
+
+bool verifyLayout(FunctionObject *fx, bool *boundary) {
+  Chunk *chunk = &fx->chunk;
+  memset(boundary, 0, sizeof(bool) * chunk->count);
+  int offset = 0;
+  while (offset < chunk->count) {
+    uint8_t instr = chunk->code[offset];
+    if (instr > OP_CALL_TARGET) return verifyError(fx, offset, "Unknown opcode");
+    if (instr == OP_CLOSURE && (offset + 1 >= chunk->count || !verifyConstant(fx, offset, chunk->code[offset + 1], FUNCTION_OBJECT))) {
+      return false;
+    }
+    boundary[offset] = true;
+    offset += instructionSize(chunk, offset);
+  }
+  if (offset != chunk->count) return verifyError(fx, chunk->count, "Truncated instruction");
+  return true;
+}
+
+bool verifyOperands(FunctionObject *fx, int offset, int depth) {
+  Chunk *chunk = &fx->chunk;
+  uint8_t instr = chunk->code[offset];
+  uint8_t operand = instructionSize(chunk, offset) > 1 ? chunk->code[offset + 1] : 0;
+  switch (instr) {
+    case OP_CONST:
+      if (operand >= chunk->constants.count) return verifyError(fx, offset, "Constant index out of range");
+      return true;
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_CLASS:
+    case OP_SQRT:
+    case OP_FLOOR:
+    case OP_CEIL:
+    case OP_ROUND:
+    case OP_TRUNC:
+    case OP_ABS:
+    case OP_MIN:
+    case OP_MAX:
+    case OP_POW:
+      return verifyConstant(fx, offset, operand, STRING_OBJECT);
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+      if (operand >= depth) return verifyError(fx, offset, "Local slot out of range");
+      return true;
+    case OP_FOR_PREP:
+    case OP_FOR_RANGE:
+      if (operand + 1 >= depth) return verifyError(fx, offset, "Range slots out of range");
+      return true;
+    case OP_CALL_TARGET: {
+      FunctionObject *target = fx->callTargets != NULL ? fx->callTargets[offset] : NULL;
+      if (target == NULL || target->arity != operand) return verifyError(fx, offset, "Call target does not match the call site");
+      return true;
+    }
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+      if (operand >= fx->upvalueCount) return verifyError(fx, offset, "Upvalue index out of range");
+      return true;
+    case OP_CLOSURE: {
+      FunctionObject *closure = AS_FUNCTION(chunk->constants.values[operand]);
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        uint8_t isLocal = chunk->code[offset + 2 + i * 2];
+        uint8_t index = chunk->code[offset + 3 + i * 2];
+        if (isLocal > 1) return verifyError(fx, offset, "Malformed upvalue descriptor");
+        if (isLocal ? index >= depth : index >= fx->upvalueCount) {
+          return verifyError(fx, offset, "Captured variable out of range");
+        }
+      }
+      return true;
+    }
+    default:
+      return true;
+  }
+}
+
+bool verifyConstant(FunctionObject *fx, int offset, int index, ObjectType type) {
+  Chunk *chunk = &fx->chunk;
+  if (index >= chunk->constants.count) return verifyError(fx, offset, "Constant index out of range");
+  Value constant = chunk->constants.values[index];
+  if (!IS_OBJECT(constant) || OBJECT_TYPE(constant) != type) return verifyError(fx, offset, "Constant has the wrong type");
+  return true;
+}
+
+bool mergeDepth(FunctionObject *fx, int *depth, int *worklist, int *pending, int offset, int incoming, bool *boundary) {
+  if (offset < 0 || offset >= fx->chunk.count || !boundary[offset]) {
+    return verifyError(fx, offset, "Jump target is not an instruction");
+  }
+  if (incoming > STACK_MAX) return verifyError(fx, offset, "Stack depth exceeds the VM stack");
+  if (depth[offset] == -1) {
+    depth[offset] = incoming;
+    worklist[(*pending)++] = offset;
+    return true;
+  }
+  if (depth[offset] != incoming) return verifyError(fx, offset, "Inconsistent stack depth at join point");
+  return true;
+}
+
+int stackEffect(uint8_t instr, uint8_t operand, int *needed) {
+  switch (instr) {
+    case OP_CONST:
+    case OP_GET_GLOBAL:
+    case OP_GET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_NULL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_CLOSURE:
+    case OP_CLASS:
+      *needed = 0;
+      return 1;
+    case OP_JMP:
+    case OP_LOOP:
+    case OP_PRINT_LN:
+    case OP_FOR_PREP:
+    case OP_FOR_RANGE:
+      *needed = 0;
+      return 0;
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_BITWISE_NOT:
+    case OP_SET_GLOBAL:
+    case OP_SET_LOCAL:
+    case OP_SET_UPVALUE:
+    case OP_JMP_IF_FALSE:
+    case OP_SQRT:
+    case OP_FLOOR:
+    case OP_CEIL:
+    case OP_ROUND:
+    case OP_TRUNC:
+    case OP_ABS:
+      *needed = 1;
+      return 0;
+    case OP_DEFINE_GLOBAL:
+    case OP_POP:
+    case OP_PRINT:
+    case OP_CLOSE_UPVALUE:
+    case OP_RETURN:
+      *needed = 1;
+      return -1;
+    case OP_CALL:
+    case OP_CALL_CLOSURE:
+    case OP_CALL_NATIVE:
+    case OP_CALL_TARGET:
+      *needed = operand + 1;
+      return -operand;
+    case OP_FORMAT:
+      *needed = operand;
+      return 1 - operand;
+    default:
+      *needed = 2;
+      return -1;
+  }
+}
@@ -1,26 +1,83 @@
 #include "vm.h"
 
+const Intrinsic intrinsics[] = {
+    {"sqrt", 1, OP_SQRT, nativeSqrt},
+    {"floor", 1, OP_FLOOR, nativeFloor},
+    {"ceil", 1, OP_CEIL, nativeCeil},
+    {"round", 1, OP_ROUND, nativeRound},
+    {"trunc", 1, OP_TRUNC, nativeTrunc},
+    {"abs", 1, OP_ABS, nativeAbs},
+    {"min", 2, OP_MIN, nativeMin},
+    {"max", 2, OP_MAX, nativeMax},
+    {"pow", 2, OP_POW, nativePow},
+    {NULL, 0, 0, NULL},
+};
+
+static char singleByteChars[UINT8_COUNT * 2];
+
 void initVM() {
   initStack();
-  vm.objects = NULL;
-  vm.openUpvalues = NULL;
+  vm.young = NULL;
+  vm.youngCount = 0;
+  vm.youngCapacity = 0;
+  vm.youngStrings = NULL;
+  vm.youngStringCount = 0;
+  vm.youngStringCapacity = 0;
   vm.grayStack = NULL;
   vm.grayCount = 0;
   vm.grayCapacity = 0;
+  vm.remembered = NULL;
+  vm.rememberedCount = 0;
+  vm.rememberedCapacity = 0;
   vm.bytesAllocated = 0;
-  vm.nextGC = 1024 * 1024;
+  initGC();
+  vm.nativeError = NULL;
+  vm.shadowedIntrinsics = 0;
+  if (getentropy(&vm.hashSeed, sizeof(vm.hashSeed)) != 0) {
+    vm.hashSeed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+  }
+  vm.profiling = false;
+  vm.profiles = NULL;
+  vm.profileCount = 0;
+  vm.profileCapacity = 0;
+  vm.sourceCount = 0;
+  vm.sourceCapacity = 0;
+  vm.sources = NULL;
+  vm.splitCursor.source = NULL;
+  vm.splitCursor.separator = NULL;
+  initSearch();
   hashTableInit(&vm.strings);
   hashTableInit(&vm.globals);
+  for (int i = 0; i < UINT8_COUNT; i++) {
+    singleByteChars[i * 2] = (char)i;
+    vm.singleBytes[i] = staticString(&singleByteChars[i * 2], 1);
+  }
   defineNative("clock", nativeClock);
+  defineNative("len", nativeLen);
+  defineNative("slice", nativeSlice);
+  defineNative("charAt", nativeCharAt);
+  defineNative("indexOf", nativeIndexOf);
+  defineNative("contains", nativeContains);
+  defineNative("count", nativeCount);
+  defineNative("split", nativeSplit);
+  defineNative("replace", nativeReplace);
+  for (const Intrinsic* intrinsic = intrinsics; intrinsic->name != NULL; intrinsic++) {
+    defineNative(intrinsic->name, intrinsic->fx);
+  }
+  promoteAll();
 }
 
 void deleteVM() {
+  stopMarker();
+  freeMarkWorkers();
+  if (vm.gc.stats) printGCStats();
+  deleteProfiles();
   hashTableDelete(&vm.strings);
   hashTableDelete(&vm.globals);
-#ifdef GC_ON
   freeObjects();
   free(vm.grayStack);
-#endif
+  for (int i = 0; i < vm.sourceCount; i++) free(vm.sources[i]);
+  free(vm.sources);
 }
 
 void push(Value value) {
@@ -29,9 +86,10 @@ void push(Value value) {
 }
 
 void initStack() {
+  if (vm.frameCount > 0) {
+    memset(vm.openUpvalues, 0, sizeof(UpvalueObject*) * (vm.stackTop - vm.stack));
+  }
   vm.stackTop = vm.stack;
-  vm.switchValTop = vm.switchVal;
-  vm.caseValTop = vm.caseVal;
   vm.frameCount = 0;
 }
 
@@ -57,40 +115,63 @@ void runtimeError(const char* format, ...) {
     if (function->name == NULL) {
       fprintf(stderr, "script\n");
     } else {
-      fprintf(stderr, "%s\n", function->name->str);
+      fprintf(stderr, "%.*s\n", function->name->length, function->name->str);
     }
   }
   initStack();
 }
 
 void concatString() {
-  StringObject* b = AS_STRING(vmStackPeek(0));
-  StringObject* a = AS_STRING(vmStackPeek(1));
-  int length = a->length + b->length;
-  char* str = ALLOCATE(char, length + 1);
-  memcpy(str, a->str, a->length);
-  memcpy(str + a->length, b->str, b->length);
-  str[length] = '\0';
-  StringObject* concatedStr = getString(str, length);
+  Object* b = AS_OBJECT(vmStackPeek(0));
+  Object* a = AS_OBJECT(vmStackPeek(1));
+  int length = textLength(a) + textLength(b);
+  Object* concated;
+  if (length >= ROPE_MIN_LENGTH) {
+    concated = (Object*)newRope(a, b);
+  } else {
+    StringObject* left = (StringObject*)a;
+    StringObject* right = (StringObject*)b;
+    char str[ROPE_MIN_LENGTH];
+    memcpy(str, left->str, left->length);
+    memcpy(str + left->length, right->str, right->length);
+    // Unsafe mode never frees, so reuse a matching literal rather than
+    // leaking a duplicate of it on every evaluation.
+    StringObject* interned =
+        vm.gc.enabled ? NULL : hashTableFindString(&vm.strings, str, length, hashString(str, length));
+    concated = interned != NULL ? (Object*)interned : (Object*)newString(str, length);
+  }
   pop();
   pop();
-  push(TO_OBJECT(concatedStr));
+  push(TO_OBJECT(concated));
+}
+
+void flattenOperands() {
+  for (Value* slot = vm.stackTop - 2; slot < vm.stackTop; slot++) {
+    if (IS_ROPE(*slot)) *slot = TO_OBJECT(flattenRope(AS_ROPE(*slot)));
+  }
 }
 
 void defineNative(const char* name, NativeFx fx) {
-  push(TO_OBJECT(copyString(name, (int)strlen(name))));
+  push(TO_OBJECT(staticString(name, (int)strlen(name))));
   push(TO_OBJECT(newNative(fx)));
+  GLOBAL_BARRIER(AS_STRING(vm.stack[0]), vm.stack[1]);
   hashTableInsertValue(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
   pop();
   pop();
 }
 
-void closeUpvalues(Value* last) {
-  while (vm.openUpvalues != NULL && vm.openUpvalues->loc >= last) {
-    UpvalueObject* upvalue = vm.openUpvalues;
+void closeUpvalues(StackFrame* frame, Value* last) {
+  int first = (int)(last - vm.stack);
+  for (int slot = (int)(vm.stackTop - vm.stack) - 1; frame->openCount > 0 && slot >= first; slot--) {
+    UpvalueObject* upvalue = vm.openUpvalues[slot];
+    if (upvalue == NULL) continue;
+    BEGIN_HEAP_WRITE();
     upvalue->closed = *upvalue->loc;
+    WRITE_BARRIER(upvalue, upvalue->closed);
+    END_HEAP_WRITE();
     upvalue->loc = &upvalue->closed;
-    vm.openUpvalues = upvalue->next;
+    vm.openUpvalues[slot] = NULL;
+    frame->openCount--;
   }
 }
 
@@ -101,13 +182,8 @@ bool isFalse(Value val) {
 bool callValue(Value callee, int argCount) {
   if (IS_OBJECT(callee)) {
     switch (OBJECT_TYPE(callee)) {
-      case NATIVE_OBJECT: {
-        NativeFx fx = AS_NATIVE(callee);
-        Value val = fx(argCount, vm.stackTop - argCount);
-        vm.stackTop -= argCount + 1;
-        push(val);
-        return true;
-      }
+      case NATIVE_OBJECT:
+        return callNative(AS_NATIVE(callee), argCount);
       case CLOSURE_OBJECT: {
         return vmCall(AS_CLOSURE(callee), argCount);
       }
@@ -119,19 +195,105 @@ bool callValue(Value callee, int argCount) {
   return false;
 }
 
+bool callNative(NativeFx fx, int argCount) {
+  Value val = fx(argCount, vm.stackTop - argCount);
+  if (vm.nativeError != NULL) {
+    runtimeError("%s", vm.nativeError);
+    vm.nativeError = NULL;
+    return false;
+  }
+  vm.stackTop -= argCount + 1;
+  push(val);
+  return true;
+}
+
+bool callShadowedIntrinsic(StringObject* name, int argCount) {
+  Value callee;
+  if (!hashTableGetValue(&vm.globals, name, &callee)) {
+    runtimeError("Undefined variable '%.*s'.", name->length, name->str);
+    return false;
+  }
+  memmove(vm.stackTop - argCount + 1, vm.stackTop - argCount, sizeof(Value) * argCount);
+  vm.stackTop[-argCount] = callee;
+  vm.stackTop++;
+  return callValue(callee, argCount);
+}
+
+bool checkMathArgs(int argCount, Value* args, int arity) {
+  if (argCount != arity) {
+    vm.nativeError = argCount < arity ? "Too few arguments to fx" : "Too many arguments to fx";
+    return false;
+  }
+  for (int i = 0; i < arity; i++) {
+    if (!IS_NUMERIC(args[i])) {
+      vm.nativeError = "Operand must be a \"Number\" type";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool checkStringArgs(int argCount, Value* args, int arity, int strings) {
+  if (argCount != arity) {
+    vm.nativeError = argCount < arity ? "Too few arguments to fx" : "Too many arguments to fx";
+    return false;
+  }
+  for (int i = 0; i < strings; i++) {
+    if (IS_ROPE(args[i])) args[i] = TO_OBJECT(flattenRope(AS_ROPE(args[i])));
+    if (!IS_STRING(args[i])) {
+      vm.nativeError = "Operand must be a \"String\" type";
+      return false;
+    }
+  }
+  for (int i = strings; i < arity; i++) {
+    if (IS_NUMBER(args[i]) && trunc(AS_NUMBER(args[i])) == AS_NUMBER(args[i])) args[i] = integralValue(AS_NUMBER(args[i]));
+    if (!IS_INTEGER(args[i])) {
+      vm.nativeError = "Index must be a whole number";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool checkPattern(StringObject* pattern) {
+  if (pattern->length == 0) {
+    vm.nativeError = "Search string must not be empty";
+    return false;
+  }
+  return true;
+}
+
+bool checkIndex(Value val, int64_t min, int64_t max, int64_t* index) {
+  *index = AS_INTEGER(val);
+  if (*index < min || *index > max) {
+    vm.nativeError = "Index out of range";
+    return false;
+  }
+  return true;
+}
+
 bool vmCall(ClosureObject* closure, int argCount) {
   if (argCount != closure->function->arity) {
     runtimeError(argCount < closure->function->arity ? "Too few arguments to fx" : "Too many arguments to fx");
     return false;
   }
+  return enterFrame(closure, argCount);
+}
+
+bool enterFrame(ClosureObject* closure, int argCount) {
   if (vm.frameCount == FRAMES_MAX) {
     runtimeError("Recursion Error: Maximum recursion depth exceeded\n                      %d stack frames were dropped", vm.frameCount);
     return false;
   }
+  if (vm.stackTop - argCount - 1 + closure->function->maxStack > vm.stack + STACK_MAX) {
+    runtimeError("Stack Overflow: Maximum stack depth exceeded");
+    return false;
+  }
   StackFrame* frame = &vm.frames[vm.frameCount++];
   frame->closure = closure;
   frame->instrPtr = closure->function->chunk.code;
   frame->slots = vm.stackTop - argCount - 1;
+  frame->openCount = 0;
   return true;
 }
 
@@ -144,19 +306,253 @@ Value nativeClock(int argCount, Value* args) {
   return TO_NUMBER((double)clock() / CLOCKS_PER_SEC);
 }
 
+Value nativeSqrt(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathSqrt(args[0]) : TO_NULL;
+}
+
+Value nativeFloor(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathFloor(args[0]) : TO_NULL;
+}
+
+Value nativeCeil(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathCeil(args[0]) : TO_NULL;
+}
+
+Value nativeRound(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathRound(args[0]) : TO_NULL;
+}
+
+Value nativeTrunc(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathTrunc(args[0]) : TO_NULL;
+}
+
+Value nativeAbs(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 1) ? mathAbs(args[0]) : TO_NULL;
+}
+
+Value nativeMin(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 2) ? mathMin(args[0], args[1]) : TO_NULL;
+}
+
+Value nativeMax(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 2) ? mathMax(args[0], args[1]) : TO_NULL;
+}
+
+Value nativePow(int argCount, Value* args) {
+  return checkMathArgs(argCount, args, 2) ? mathPow(args[0], args[1]) : TO_NULL;
+}
+
+Value nativeLen(int argCount, Value* args) {
+  return checkStringArgs(argCount, args, 1, 1) ? TO_INTEGER(AS_STRING(args[0])->length) : TO_NULL;
+}
+
+Value nativeSlice(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 3, 1)) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  int64_t start, end;
+  if (!checkIndex(args[1], 0, string->length, &start) || !checkIndex(args[2], start, string->length, &end)) {
+    return TO_NULL;
+  }
+  return TO_OBJECT(sliceString(string, (int)start, (int)end));
+}
+
+Value nativeCharAt(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 2, 1)) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  int64_t index;
+  if (!checkIndex(args[1], 0, string->length - 1, &index)) return TO_NULL;
+  return TO_OBJECT(vm.singleBytes[(uint8_t)string->str[index]]);
+}
+
+Value nativeIndexOf(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, argCount > 2 ? 3 : 2, 2)) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  StringObject* pattern = AS_STRING(args[1]);
+  int64_t from = 0;
+  if (argCount > 2 && !checkIndex(args[2], 0, string->length, &from)) return TO_NULL;
+  int found = searchString(string->str + from, string->length - (int)from, pattern->str, pattern->length);
+  return TO_INTEGER(found < 0 ? -1 : from + found);
+}
+
+Value nativeContains(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 2, 2)) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  StringObject* pattern = AS_STRING(args[1]);
+  return TO_BOOL(searchString(string->str, string->length, pattern->str, pattern->length) >= 0);
+}
+
+Value nativeCount(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 2, 2) || !checkPattern(AS_STRING(args[1]))) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  StringObject* pattern = AS_STRING(args[1]);
+  int64_t count = 0;
+  int start = 0;
+  while (true) {
+    int found = searchString(string->str + start, string->length - start, pattern->str, pattern->length);
+    if (found < 0) break;
+    start += found + pattern->length;
+    count++;
+  }
+  return TO_INTEGER(count);
+}
+
+Value nativeSplit(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 3, 2) || !checkPattern(AS_STRING(args[1]))) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  StringObject* separator = AS_STRING(args[1]);
+  int64_t index;
+  if (!checkIndex(args[2], 0, string->length, &index)) return TO_NULL;
+  SplitCursor* cursor = &vm.splitCursor;
+  if (cursor->source != string || cursor->index > index ||
+      (cursor->separator != separator && !stringsEqual(cursor->separator, separator))) {
+    cursor->source = string;
+    cursor->separator = separator;
+    cursor->index = 0;
+    cursor->start = 0;
+    cursor->end = pieceEnd(string, separator, 0);
+  }
+  while (cursor->index < index) {
+    if (cursor->end == string->length) {
+      vm.nativeError = "Index out of range";
+      return TO_NULL;
+    }
+    cursor->start = cursor->end + separator->length;
+    cursor->end = pieceEnd(string, separator, cursor->start);
+    cursor->index++;
+  }
+  return TO_OBJECT(sliceString(string, cursor->start, cursor->end));
+}
+
+Value nativeReplace(int argCount, Value* args) {
+  if (!checkStringArgs(argCount, args, 3, 3) || !checkPattern(AS_STRING(args[1]))) return TO_NULL;
+  StringObject* string = AS_STRING(args[0]);
+  StringObject* pattern = AS_STRING(args[1]);
+  StringObject* replacement = AS_STRING(args[2]);
+  int count = 0;
+  int capacity = 0;
+  int* matches = NULL;
+  int start = 0;
+  while (true) {
+    int found = searchString(string->str + start, string->length - start, pattern->str, pattern->length);
+    if (found < 0) break;
+    if (capacity < count + 1) {
+      capacity = GROW_CAPACITY(capacity);
+      matches = (int*)realloc(matches, sizeof(int) * capacity);
+      if (matches == NULL) exit(1);
+    }
+    matches[count++] = start + found;
+    start += found + pattern->length;
+  }
+  if (count == 0) return args[0];
+  int64_t length = string->length + (int64_t)count * (replacement->length - pattern->length);
+  if (length > INT32_MAX) {
+    free(matches);
+    vm.nativeError = "String too long";
+    return TO_NULL;
+  }
+  StringObject* replaced = reserveString((int)length);
+  char* str = replaced->str;
+  start = 0;
+  for (int i = 0; i < count; i++) {
+    memcpy(str, string->str + start, matches[i] - start);
+    str += matches[i] - start;
+    memcpy(str, replacement->str, replacement->length);
+    str += replacement->length;
+    start = matches[i] + pattern->length;
+  }
+  memcpy(str, string->str + start, string->length - start);
+  str[string->length - start] = '\0';
+  free(matches);
+  return TO_OBJECT(replaced);
+}
+
+Value mathSqrt(Value val) {
+  return TO_NUMBER(sqrt(AS_DOUBLE(val)));
+}
+
+Value integralValue(double value) {
+  return value >= -0x1p63 && value < 0x1p63 ? TO_INTEGER((int64_t)value) : TO_NUMBER(value);
+}
+
+Value mathFloor(Value val) {
+  return IS_INTEGER(val) ? val : integralValue(floor(AS_NUMBER(val)));
+}
+
+Value mathCeil(Value val) {
+  return IS_INTEGER(val) ? val : integralValue(ceil(AS_NUMBER(val)));
+}
+
+Value mathRound(Value val) {
+  return IS_INTEGER(val) ? val : integralValue(round(AS_NUMBER(val)));
+}
+
+Value mathTrunc(Value val) {
+  return IS_INTEGER(val) ? val : integralValue(trunc(AS_NUMBER(val)));
+}
+
+Value mathAbs(Value val) {
+  if (IS_INTEGER(val)) {
+    return AS_INTEGER(val) < 0 ? TO_INTEGER((int64_t)(0 - (uint64_t)AS_INTEGER(val))) : val;
+  }
+  return TO_NUMBER(fabs(AS_NUMBER(val)));
+}
+
+Value mathMin(Value a, Value b) {
+  if (IS_INTEGER(a) && IS_INTEGER(b)) return AS_INTEGER(a) < AS_INTEGER(b) ? a : b;
+  return TO_NUMBER(fmin(AS_DOUBLE(a), AS_DOUBLE(b)));
+}
+
+Value mathMax(Value a, Value b) {
+  if (IS_INTEGER(a) && IS_INTEGER(b)) return AS_INTEGER(a) > AS_INTEGER(b) ? a : b;
+  return TO_NUMBER(fmax(AS_DOUBLE(a), AS_DOUBLE(b)));
+}
+
+Value mathPow(Value a, Value b) {
+  return TO_NUMBER(pow(AS_DOUBLE(a), AS_DOUBLE(b)));
+}
+
+int findIntrinsic(const char* name, int length) {
+  for (int i = 0; intrinsics[i].name != NULL; i++) {
+    if ((int)strlen(intrinsics[i].name) == length && memcmp(intrinsics[i].name, name, length) == 0) return i;
+  }
+  return -1;
+}
+
 Value vmStackPeek(int far) {
   return vm.stackTop[-1 - far];
 }
 
+// String constants point into the source they were compiled from, so the
+// VM keeps its own copy of every source until it is deleted.
+const char* retainSource(const char* source) {
+  if (vm.sourceCapacity < vm.sourceCount + 1) {
+    vm.sourceCapacity = GROW_CAPACITY(vm.sourceCapacity);
+    vm.sources = (char**)realloc(vm.sources, sizeof(char*) * vm.sourceCapacity);
+    if (vm.sources == NULL) exit(1);
+  }
+  size_t length = strlen(source);
+  char* copy = (char*)malloc(length + 1);
+  if (copy == NULL) exit(1);
+  memcpy(copy, source, length + 1);
+  vm.sources[vm.sourceCount++] = copy;
+  return copy;
+}
+
 IR interpret(const char* source) {
-  FunctionObject* function = compile(source);
+  vm.gc.compiling = true;
+  FunctionObject* function = compile(retainSource(source));
+  vm.gc.compiling = false;
   if (function == NULL) return I_COMPILE_ERR;
+  if (vm.profileCount > 0) applyProfile(function);
+  if (!verifyFunction(function)) return I_COMPILE_ERR;
   push(TO_OBJECT(function));
   ClosureObject* closure = newClosure(function);
   pop();
   push(TO_OBJECT(closure));
   callValue(TO_OBJECT(closure), 0);
-  return run();
+  IR res = run();
+  if (vm.profiling) collectProfile(function);
+  return res;
 }
 
 IR run() {
@@ -165,15 +561,109 @@ IR run() {
 #define READ_CONST() (frame->closure->function->chunk.constants.values[READ_BYTE()])
 #define READ_SHORT() (frame->instrPtr += 2, (uint16_t)((frame->instrPtr[-2] << 8) | frame->instrPtr[-1]))
 #define READ_STRING() AS_STRING(READ_CONST())
-#define BINARY_OP(valType, op)                                      \
-  do {                                                              \
-    if (!IS_NUMBER(vmStackPeek(0)) || !IS_NUMBER(vmStackPeek(0))) { \
-      runtimeError("Operand must be a \"Number\" type");            \
-      return I_RUNTIME_ERR;                                         \
-    }                                                               \
-    double b = AS_NUMBER(pop());                                    \
-    double a = AS_NUMBER(pop());                                    \
-    push(valType(a op b));                                          \
+#define BINARY_OP(valType, op)                                          \
+  do {                                                                  \
+    if (!IS_NUMERIC(vmStackPeek(0)) || !IS_NUMERIC(vmStackPeek(1))) {   \
+      runtimeError("Operand must be a \"Number\" type");                \
+      return I_RUNTIME_ERR;                                             \
+    }                                                                   \
+    b = pop();                                                          \
+    a = pop();                                                          \
+    if (IS_INTEGER(a) && IS_INTEGER(b)) {                               \
+      push(valType(AS_INTEGER(a) op AS_INTEGER(b)));                    \
+    } else {                                                            \
+      push(valType(AS_DOUBLE(a) op AS_DOUBLE(b)));                      \
+    }                                                                   \
+  } while (false)
+#define ARITHMETIC_OP(op)                                                        \
+  do {                                                                           \
+    if (!IS_NUMERIC(vmStackPeek(0)) || !IS_NUMERIC(vmStackPeek(1))) {            \
+      runtimeError("Operand must be a \"Number\" type");                         \
+      return I_RUNTIME_ERR;                                                      \
+    }                                                                            \
+    b = pop();                                                                   \
+    a = pop();                                                                   \
+    if (IS_INTEGER(a) && IS_INTEGER(b)) {                                        \
+      push(TO_INTEGER((int64_t)((uint64_t)AS_INTEGER(a) op(uint64_t) AS_INTEGER(b)))); \
+    } else {                                                                     \
+      push(TO_NUMBER(AS_DOUBLE(a) op AS_DOUBLE(b)));                             \
+    }                                                                            \
+  } while (false)
+#define INSTR_OFFSET(size) ((int)(frame->instrPtr - frame->closure->function->chunk.code) - (size))
+#define PROFILE_BINARY()                                                                                            \
+  do {                                                                                                              \
+    if (vm.profiling) recordBinaryFeedback(frame->closure->function, INSTR_OFFSET(1), vmStackPeek(1), vmStackPeek(0)); \
+  } while (false)
+#define DEOPTIMIZE(generic)            \
+  do {                                 \
+    frame->instrPtr[-1] = generic;     \
+    frame->instrPtr--;                 \
+  } while (false)
+#define QUICK_INT_OP(generic, valType, op)                                           \
+  do {                                                                               \
+    if (!IS_INTEGER(vmStackPeek(0)) || !IS_INTEGER(vmStackPeek(1))) {                \
+      DEOPTIMIZE(generic);                                                           \
+    } else {                                                                         \
+      uint64_t b = (uint64_t)AS_INTEGER(vm.stackTop[-1]);                            \
+      uint64_t a = (uint64_t)AS_INTEGER(vm.stackTop[-2]);                            \
+      vm.stackTop[-2] = valType((int64_t)(a op b));                                  \
+      vm.stackTop--;                                                                 \
+    }                                                                                \
+  } while (false)
+#define QUICK_INT_COMPARE(generic, op)                                               \
+  do {                                                                               \
+    if (!IS_INTEGER(vmStackPeek(0)) || !IS_INTEGER(vmStackPeek(1))) {                \
+      DEOPTIMIZE(generic);                                                           \
+    } else {                                                                         \
+      vm.stackTop[-2] = TO_BOOL(AS_INTEGER(vm.stackTop[-2]) op AS_INTEGER(vm.stackTop[-1])); \
+      vm.stackTop--;                                                                 \
+    }                                                                                \
+  } while (false)
+#define QUICK_NUM_OP(generic, valType, op)                                           \
+  do {                                                                               \
+    if (!IS_NUMBER(vmStackPeek(0)) || !IS_NUMBER(vmStackPeek(1))) {                  \
+      DEOPTIMIZE(generic);                                                           \
+    } else {                                                                         \
+      vm.stackTop[-2] = valType(AS_NUMBER(vm.stackTop[-2]) op AS_NUMBER(vm.stackTop[-1])); \
+      vm.stackTop--;                                                                 \
+    }                                                                                \
+  } while (false)
+#define UNARY_INTRINSIC(fn)                                                 \
+  do {                                                                      \
+    StringObject* name = READ_STRING();                                     \
+    if (vm.shadowedIntrinsics & INTRINSIC_BIT(instr)) {                     \
+      if (!callShadowedIntrinsic(name, 1)) return I_RUNTIME_ERR;            \
+      frame = &vm.frames[vm.frameCount - 1];                                \
+    } else if (!IS_NUMERIC(vmStackPeek(0))) {                               \
+      runtimeError("Operand must be a \"Number\" type");                    \
+      return I_RUNTIME_ERR;                                                 \
+    } else {                                                                \
+      vm.stackTop[-1] = fn(vm.stackTop[-1]);                                \
+    }                                                                       \
+  } while (false)
+#define BINARY_INTRINSIC(fn)                                                \
+  do {                                                                      \
+    StringObject* name = READ_STRING();                                     \
+    if (vm.shadowedIntrinsics & INTRINSIC_BIT(instr)) {                     \
+      if (!callShadowedIntrinsic(name, 2)) return I_RUNTIME_ERR;            \
+      frame = &vm.frames[vm.frameCount - 1];                                \
+    } else if (!IS_NUMERIC(vmStackPeek(0)) || !IS_NUMERIC(vmStackPeek(1))) { \
+      runtimeError("Operand must be a \"Number\" type");                    \
+      return I_RUNTIME_ERR;                                                 \
+    } else {                                                                \
+      vm.stackTop[-2] = fn(vm.stackTop[-2], vm.stackTop[-1]);               \
+      vm.stackTop--;                                                        \
+    }                                                                       \
+  } while (false)
+#define INTEGER_OP(op)                                                 \
+  do {                                                                 \
+    if (!IS_INTEGER(vmStackPeek(0)) || !IS_INTEGER(vmStackPeek(1))) {  \
+      runtimeError("Operand must be an \"Integer\" type");             \
+      return I_RUNTIME_ERR;                                            \
+    }                                                                  \
+    int64_t b = AS_INTEGER(pop());                                     \
+    int64_t a = AS_INTEGER(pop());                                     \
+    push(TO_INTEGER(a op b));                                          \
   } while (false)
   while (true) {
 #ifdef DEBUG_TRACE_EXECUTION
@@ -192,46 +682,32 @@ IR run() {
     uint8_t instr = READ_BYTE();
     Value constant, a, b;
     switch (instr) {
-      case OP_BRK:
-        *(vm.caseValTop - 1) = false;
-        break;
-      case OP_SWITCH_START:
-        *(vm.switchValTop) = pop();
-        vm.switchValTop++;
-        *(vm.caseValTop) = false;
-        vm.caseValTop++;
-        break;
-      case OP_SWITCH_END:
-        vm.switchValTop--;
-        vm.caseValTop--;
-        if (vm.switchValTop == &vm.switchVal[0]) pop();
-        break;
-      case OP_CASE: {
-        bool eq = *(vm.caseValTop - 1) || isEqual(*(vm.switchValTop - 1), pop());
-        *(vm.caseValTop - 1) = eq;
-        push(TO_BOOL(eq));
-        break;
-      }
       case OP_EQUAL:
+        flattenOperands();
         a = pop();
         b = pop();
         push(TO_BOOL(isEqual(a, b)));
         break;
       case OP_NOT_EQUAL:
+        flattenOperands();
         a = pop();
         b = pop();
         push(TO_BOOL(!isEqual(a, b)));
         break;
       case OP_GREATER:
+        PROFILE_BINARY();
         BINARY_OP(TO_BOOL, >);
         break;
       case OP_LESS:
+        PROFILE_BINARY();
         BINARY_OP(TO_BOOL, <);
         break;
       case OP_GREATER_EQUAL:
+        PROFILE_BINARY();
         BINARY_OP(TO_BOOL, >=);
         break;
       case OP_LESS_EQUAL:
+        PROFILE_BINARY();
         BINARY_OP(TO_BOOL, <=);
         break;
       case OP_NOT:
@@ -251,44 +727,224 @@ IR run() {
         push(constant);
         break;
       case OP_ADD:
-        if (IS_STRING(vmStackPeek(0)) && IS_STRING(vmStackPeek(1))) {
+        PROFILE_BINARY();
+        if (IS_TEXT(vmStackPeek(0)) && IS_TEXT(vmStackPeek(1))) {
           concatString();
-        } else if (IS_NUMBER(vmStackPeek(0)) && IS_NUMBER(vmStackPeek(1))) {
-          double b = AS_NUMBER(pop());
-          double a = AS_NUMBER(pop());
-          push(TO_NUMBER(a + b));
+        } else if (IS_NUMERIC(vmStackPeek(0)) && IS_NUMERIC(vmStackPeek(1))) {
+          ARITHMETIC_OP(+);
         } else {
           runtimeError("Invalid Operation! Operand must be \"Number\" or \"String\" type");
+          return I_RUNTIME_ERR;
         }
         break;
       case OP_SUBTRACT:
-        BINARY_OP(TO_NUMBER, -);
+        PROFILE_BINARY();
+        ARITHMETIC_OP(-);
         break;
       case OP_MODULO: {
-        double b = AS_NUMBER(pop());
-        double a = AS_NUMBER(pop());
-        push(TO_NUMBER(fmod(a, b)));
+        if (!IS_NUMERIC(vmStackPeek(0)) || !IS_NUMERIC(vmStackPeek(1))) {
+          runtimeError("Operand must be a \"Number\" type");
+          return I_RUNTIME_ERR;
+        }
+        b = pop();
+        a = pop();
+        if (IS_INTEGER(a) && IS_INTEGER(b)) {
+          if (AS_INTEGER(b) == 0) {
+            runtimeError("Math Error: Integer modulo by zero");
+            return I_RUNTIME_ERR;
+          }
+          push(TO_INTEGER(AS_INTEGER(b) == -1 ? 0 : AS_INTEGER(a) % AS_INTEGER(b)));
+        } else {
+          push(TO_NUMBER(fmod(AS_DOUBLE(a), AS_DOUBLE(b))));
+        }
         break;
       }
       case OP_MULTIPLY:
-        BINARY_OP(TO_NUMBER, *);
+        PROFILE_BINARY();
+        ARITHMETIC_OP(*);
         break;
       case OP_DIVIDE:
-        BINARY_OP(TO_NUMBER, /);
+        if (!IS_NUMERIC(vmStackPeek(0)) || !IS_NUMERIC(vmStackPeek(1))) {
+          runtimeError("Operand must be a \"Number\" type");
+          return I_RUNTIME_ERR;
+        }
+        b = pop();
+        a = pop();
+        if (IS_INTEGER(a) && IS_INTEGER(b) && AS_INTEGER(b) == 0) {
+          runtimeError("Math Error: Integer division by zero");
+          return I_RUNTIME_ERR;
+        }
+        if (IS_INTEGER(a) && IS_INTEGER(b) && !(AS_INTEGER(a) == INT64_MIN && AS_INTEGER(b) == -1) &&
+            AS_INTEGER(a) % AS_INTEGER(b) == 0) {
+          push(TO_INTEGER(AS_INTEGER(a) / AS_INTEGER(b)));
+        } else {
+          push(TO_NUMBER(AS_DOUBLE(a) / AS_DOUBLE(b)));
+        }
         break;
       case OP_NEGATE:
+        if (IS_INTEGER(vmStackPeek(0))) {
+          push(TO_INTEGER((int64_t)(0 - (uint64_t)AS_INTEGER(pop()))));
+          break;
+        }
         if (!IS_NUMBER(vmStackPeek(0))) {
           runtimeError("Operand must be a \"Number\" type");
           return I_RUNTIME_ERR;
         }
         push(TO_NUMBER(-AS_NUMBER(pop())));
         break;
+      case OP_BITWISE_AND:
+        INTEGER_OP(&);
+        break;
+      case OP_BITWISE_OR:
+        INTEGER_OP(|);
+        break;
+      case OP_BITWISE_XOR:
+        INTEGER_OP(^);
+        break;
+      case OP_BITWISE_NOT:
+        if (!IS_INTEGER(vmStackPeek(0))) {
+          runtimeError("Operand must be an \"Integer\" type");
+          return I_RUNTIME_ERR;
+        }
+        push(TO_INTEGER(~AS_INTEGER(pop())));
+        break;
+      case OP_LEFT_SHIFT:
+      case OP_RIGHT_SHIFT: {
+        if (!IS_INTEGER(vmStackPeek(0)) || !IS_INTEGER(vmStackPeek(1))) {
+          runtimeError("Operand must be an \"Integer\" type");
+          return I_RUNTIME_ERR;
+        }
+        int64_t shift = AS_INTEGER(pop());
+        int64_t value = AS_INTEGER(pop());
+        if (shift < 0 || shift > 63) {
+          runtimeError("Math Error: Shift count %" PRId64 " is out of range", shift);
+          return I_RUNTIME_ERR;
+        }
+        push(TO_INTEGER(instr == OP_LEFT_SHIFT ? (int64_t)((uint64_t)value << shift) : value >> shift));
+        break;
+      }
       case OP_CALL: {
         int argCount = READ_BYTE();
+        if (vm.profiling) recordCallFeedback(frame->closure->function, INSTR_OFFSET(2), vmStackPeek(argCount));
         if (!callValue(vmStackPeek(argCount), argCount)) return I_RUNTIME_ERR;
         frame = &vm.frames[vm.frameCount - 1];
         break;
       }
+      case OP_ADD_INT:
+        QUICK_INT_OP(OP_ADD, TO_INTEGER, +);
+        break;
+      case OP_ADD_NUM:
+        QUICK_NUM_OP(OP_ADD, TO_NUMBER, +);
+        break;
+      case OP_SUBTRACT_INT:
+        QUICK_INT_OP(OP_SUBTRACT, TO_INTEGER, -);
+        break;
+      case OP_SUBTRACT_NUM:
+        QUICK_NUM_OP(OP_SUBTRACT, TO_NUMBER, -);
+        break;
+      case OP_MULTIPLY_INT:
+        QUICK_INT_OP(OP_MULTIPLY, TO_INTEGER, *);
+        break;
+      case OP_MULTIPLY_NUM:
+        QUICK_NUM_OP(OP_MULTIPLY, TO_NUMBER, *);
+        break;
+      case OP_LESS_INT:
+        QUICK_INT_COMPARE(OP_LESS, <);
+        break;
+      case OP_LESS_NUM:
+        QUICK_NUM_OP(OP_LESS, TO_BOOL, <);
+        break;
+      case OP_LESS_EQUAL_INT:
+        QUICK_INT_COMPARE(OP_LESS_EQUAL, <=);
+        break;
+      case OP_LESS_EQUAL_NUM:
+        QUICK_NUM_OP(OP_LESS_EQUAL, TO_BOOL, <=);
+        break;
+      case OP_GREATER_INT:
+        QUICK_INT_COMPARE(OP_GREATER, >);
+        break;
+      case OP_GREATER_NUM:
+        QUICK_NUM_OP(OP_GREATER, TO_BOOL, >);
+        break;
+      case OP_GREATER_EQUAL_INT:
+        QUICK_INT_COMPARE(OP_GREATER_EQUAL, >=);
+        break;
+      case OP_GREATER_EQUAL_NUM:
+        QUICK_NUM_OP(OP_GREATER_EQUAL, TO_BOOL, >=);
+        break;
+      case OP_CALL_CLOSURE: {
+        int argCount = READ_BYTE();
+        if (!IS_CLOSURE(vmStackPeek(argCount))) {
+          frame->instrPtr -= 2;
+          *frame->instrPtr = OP_CALL;
+          break;
+        }
+        if (!vmCall(AS_CLOSURE(vmStackPeek(argCount)), argCount)) return I_RUNTIME_ERR;
+        frame = &vm.frames[vm.frameCount - 1];
+        break;
+      }
+      case OP_CALL_NATIVE: {
+        int argCount = READ_BYTE();
+        if (!IS_NATIVE(vmStackPeek(argCount))) {
+          frame->instrPtr -= 2;
+          *frame->instrPtr = OP_CALL;
+          break;
+        }
+        if (!callNative(AS_NATIVE(vmStackPeek(argCount)), argCount)) return I_RUNTIME_ERR;
+        break;
+      }
+      case OP_CALL_TARGET: {
+        int argCount = READ_BYTE();
+        Value callee = vmStackPeek(argCount);
+        FunctionObject* fx = frame->closure->function;
+        if (!IS_CLOSURE(callee) || AS_CLOSURE(callee)->function != fx->callTargets[INSTR_OFFSET(2)]) {
+          if (vm.profiling) recordCallFeedback(fx, INSTR_OFFSET(2), callee);
+          frame->instrPtr -= 2;
+          *frame->instrPtr = OP_CALL_CLOSURE;
+          break;
+        }
+        if (!enterFrame(AS_CLOSURE(callee), argCount)) return I_RUNTIME_ERR;
+        frame = &vm.frames[vm.frameCount - 1];
+        break;
+      }
+      case OP_SQRT:
+        UNARY_INTRINSIC(mathSqrt);
+        break;
+      case OP_FLOOR:
+        UNARY_INTRINSIC(mathFloor);
+        break;
+      case OP_CEIL:
+        UNARY_INTRINSIC(mathCeil);
+        break;
+      case OP_ROUND:
+        UNARY_INTRINSIC(mathRound);
+        break;
+      case OP_TRUNC:
+        UNARY_INTRINSIC(mathTrunc);
+        break;
+      case OP_ABS:
+        UNARY_INTRINSIC(mathAbs);
+        break;
+      case OP_MIN:
+        BINARY_INTRINSIC(mathMin);
+        break;
+      case OP_MAX:
+        BINARY_INTRINSIC(mathMax);
+        break;
+      case OP_POW:
+        BINARY_INTRINSIC(mathPow);
+        break;
+      case OP_FORMAT: {
+        int count = READ_BYTE();
+        StringObject* formatted = formatString(vm.stackTop - count, count);
+        if (formatted == NULL) {
+          runtimeError("Invalid Operation! Interpolated value must be \"String\", \"Number\", \"Boolean\" or null");
+          return I_RUNTIME_ERR;
+        }
+        vm.stackTop -= count;
+        push(TO_OBJECT(formatted));
+        break;
+      }
       case OP_GET_UPVALUE: {
         uint8_t slot = READ_BYTE();
         push(*frame->closure->upvalues[slot]->loc);
@@ -296,7 +952,11 @@ IR run() {
       }
       case OP_SET_UPVALUE: {
         uint8_t slot = READ_BYTE();
-        *frame->closure->upvalues[slot]->loc = vmStackPeek(0);
+        UpvalueObject* upvalue = frame->closure->upvalues[slot];
+        BEGIN_HEAP_WRITE();
+        *upvalue->loc = vmStackPeek(0);
+        WRITE_BARRIER(upvalue, vmStackPeek(0));
+        END_HEAP_WRITE();
         break;
       }
       case OP_GET_LOCAL: {
@@ -319,6 +979,38 @@ IR run() {
         frame->instrPtr -= offset;
         break;
       }
+      case OP_FOR_PREP: {
+        Value* counter = &frame->slots[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        if (!IS_NUMERIC(counter[0]) || !IS_NUMERIC(counter[1])) {
+          runtimeError("Range bounds must be \"Number\" type");
+          return I_RUNTIME_ERR;
+        }
+        if (IS_INTEGER(counter[0]) && IS_INTEGER(counter[1])) {
+          if (AS_INTEGER(counter[0]) >= AS_INTEGER(counter[1])) frame->instrPtr += offset;
+        } else if (AS_DOUBLE(counter[0]) >= AS_DOUBLE(counter[1])) {
+          frame->instrPtr += offset;
+        }
+        break;
+      }
+      case OP_FOR_RANGE: {
+        Value* counter = &frame->slots[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        if (IS_INTEGER(counter[0]) && IS_INTEGER(counter[1])) {
+          if (++AS_INTEGER(counter[0]) < AS_INTEGER(counter[1])) frame->instrPtr -= offset;
+          break;
+        }
+        if (IS_INTEGER(counter[0])) {
+          AS_INTEGER(counter[0])++;
+        } else if (IS_NUMBER(counter[0])) {
+          AS_NUMBER(counter[0])++;
+        } else {
+          runtimeError("Range counter must be a \"Number\" type");
+          return I_RUNTIME_ERR;
+        }
+        if (AS_DOUBLE(counter[0]) < AS_DOUBLE(counter[1])) frame->instrPtr -= offset;
+        break;
+      }
       case OP_SET_LOCAL: {
         uint8_t slot = READ_BYTE();
         frame->slots[slot] = vmStackPeek(0);
@@ -326,6 +1018,7 @@ IR run() {
       }
       case OP_DEFINE_GLOBAL: {
         StringObject* name = READ_STRING();
+        GLOBAL_BARRIER(name, vmStackPeek(0));
         hashTableInsertValue(&vm.globals, name, vmStackPeek(0));
         pop();
         break;
@@ -334,7 +1027,7 @@ IR run() {
         StringObject* name = READ_STRING();
         Value val;
         if (!hashTableGetValue(&vm.globals, name, &val)) {
-          runtimeError("Undefined variable '%s'.", name->str);
+          runtimeError("Undefined variable '%.*s'.", name->length, name->str);
           return I_RUNTIME_ERR;
         }
         push(val);
@@ -342,9 +1035,10 @@ IR run() {
       }
       case OP_SET_GLOBAL: {
         StringObject* name = READ_STRING();
+        GLOBAL_BARRIER(name, vmStackPeek(0));
         if (hashTableInsertValue(&vm.globals, name, vmStackPeek(0))) {
           hashTableDeleteValue(&vm.globals, name);
-          runtimeError("Undefined variable '%s'.", name->str);
+          runtimeError("Undefined variable '%.*s'.", name->length, name->str);
           return I_RUNTIME_ERR;
         }
         break;
@@ -360,27 +1054,38 @@ IR run() {
         break;
       case OP_CLOSURE: {
         FunctionObject* fx = AS_FUNCTION(READ_CONST());
+        if (fx->upvalueCount == 0) {
+          if (fx->closure == NULL) {
+            ClosureObject* closure = newClosure(fx);
+            BEGIN_HEAP_WRITE();
+            fx->closure = closure;
+            WRITE_BARRIER(fx, TO_OBJECT(closure));
+            END_HEAP_WRITE();
+          }
+          push(TO_OBJECT(fx->closure));
+          break;
+        }
         ClosureObject* closure = newClosure(fx);
         push(TO_OBJECT(closure));
         for (int i = 0; i < closure->upvalueCount; i++) {
           uint8_t isLocal = READ_BYTE();
           uint8_t index = READ_BYTE();
-          if (isLocal) {
-            closure->upvalues[i] = captureUpvalue(frame->slots + index);
-          } else {
-            closure->upvalues[i] = frame->closure->upvalues[index];
-          }
+          UpvalueObject* upvalue = isLocal ? captureUpvalue(frame, frame->slots + index) : frame->closure->upvalues[index];
+          BEGIN_HEAP_WRITE();
+          closure->upvalues[i] = upvalue;
+          WRITE_BARRIER(closure, TO_OBJECT(upvalue));
+          END_HEAP_WRITE();
         }
         break;
       }
       case OP_CLOSE_UPVALUE: {
-        closeUpvalues(vm.stackTop - 1);
+        closeUpvalues(frame, vm.stackTop - 1);
         pop();
         break;
       }
       case OP_RETURN: {
         Value res = pop();
-        closeUpvalues(frame->slots);
+        if (frame->openCount > 0) closeUpvalues(frame, frame->slots);
         vm.frameCount--;
         if (vm.frameCount == 0) {
           pop();
@@ -398,22 +1103,28 @@ IR run() {
 #undef READ_SHORT
 #undef READ_STRING
 #undef BINARY_OP
+#undef ARITHMETIC_OP
+#undef INTEGER_OP
+#undef UNARY_INTRINSIC
+#undef BINARY_INTRINSIC
+#undef INSTR_OFFSET
+#undef PROFILE_BINARY
+#undef DEOPTIMIZE
+#undef QUICK_INT_OP
+#undef QUICK_INT_COMPARE
+#undef QUICK_NUM_OP
 }
 
-UpvalueObject* captureUpvalue(Value* local) {
-  UpvalueObject* prevUpvalue = NULL;
-  UpvalueObject* upvalue = vm.openUpvalues;
-  while (upvalue != NULL && upvalue->loc > local) {
-    prevUpvalue = upvalue;
-    upvalue = upvalue->next;
+UpvalueObject* captureUpvalue(StackFrame* frame, Value* local) {
+  UpvalueObject** open = &vm.openUpvalues[local - vm.stack];
+  if (*open == NULL) {
+    *open = newUpvalue(local);
+    frame->openCount++;
   }
-  if (upvalue != NULL && upvalue->loc == local) return upvalue;
-  UpvalueObject* createdUpvalue = newUpvalue(local);
-  createdUpvalue->next = upvalue;
-  if (prevUpvalue == NULL) {
-    vm.openUpvalues = createdUpvalue;
-  } else {
-    prevUpvalue->next = createdUpvalue;
-  }
-  return createdUpvalue;
+  return *open;
+}
+
+int pieceEnd(StringObject* string, StringObject* separator, int start) {
+  int found = searchString(string->str + start, string->length - start, separator->str, separator->length);
+  return found < 0 ? string->length : start + found;
 }
\ No newline at end of file
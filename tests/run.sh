@@ -0,0 +1,18 @@
+#!/bin/sh
+# Runs every tests/*.mlc and compares its stdout followed by its stderr,
+# with colours stripped, against the matching .out file.
+mlc=${1:-bin/mlc}
+err=$(mktemp)
+status=0
+for test in tests/*.mlc; do
+  actual=$("$mlc" "$test" 2>"$err"; sed 's/\x1b\[[0-9;]*m//g' "$err")
+  if [ "$actual" = "$(cat "${test%.mlc}.out")" ]; then
+    echo "PASS $test"
+  else
+    echo "FAIL $test"
+    echo "$actual" | diff "${test%.mlc}.out" -
+    status=1
+  fi
+done
+rm -f "$err"
+exit $status